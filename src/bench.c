@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "parse.h"
+
+/* Seconds a microbenchmark runs for at least */
+#define BENCH_MIN_TIME 0.25
+
+/* Repetitions of a command line in one end-to-end run */
+#define BENCH_COMMANDS 2000
+#define BENCH_PIPELINES 100
+
+/* Bytes pushed through the cat chain */
+#define BENCH_CHAIN_BYTES (256L << 20)
+#define BENCH_CHAIN_CATS 4
+
+/* Longest pipeline whose latency is measured, lengths double up to it */
+#define BENCH_MAX_STAGES 16
+
+/**
+ * Command lines parsed by the microbenchmarks, from simple commands to
+ * long pipelines with redirections
+ */
+static const struct {
+	const char *name;
+	const char *line;
+} corpus[] = {
+	{ "simple", "ls" },
+	{ "args", "ls -la --color=auto /usr/local/bin" },
+	{ "background", "make -j8 all &" },
+	{ "redirect", "sort -k2 -n < data.txt > sorted.txt" },
+	{ "pipeline", "cat /etc/passwd | grep root | cut -d : -f 1" },
+	{ "long-pipeline", "zcat access.log.gz | grep GET | cut -d , -f 7 | sort | uniq -c | sort -rn | head -n 20 > top.txt" },
+	{ "many-args", "gcc -O2 -g -Wall -Wextra -DNDEBUG -I include -I src -o fsh parse.c shell.c hash.c input.c jobs.c events.c parallel.c builtins.c" },
+};
+
+/**
+ * @brief Seconds since an arbitrary point, from CLOCK_MONOTONIC
+ * 
+ * @return Seconds
+ */
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Prints one result as a line of JSON
+ * 
+ * @param name Benchmark
+ * @param variant Case of benchmark
+ * @param iterations Number of operations measured
+ * @param value Result
+ * @param unit Unit of result
+ */
+static void report(const char *name, const char *variant, long iterations, double value, const char *unit) {
+	printf("{\"name\": \"%s\", \"case\": \"%s\", \"iterations\": %ld, \"value\": %.3f, \"unit\": \"%s\"}\n",
+		name, variant, iterations, value, unit);
+	fflush(stdout);
+}
+
+/**
+ * @brief Parses a line and frees its command table
+ * 
+ * @param line Command line
+ */
+static void parseOnce(const char *line) {
+	char buf[256];
+	cmdTable cmdTab;
+
+	/* parse() may write into the line it is given */
+	strcpy(buf, line);
+	initCmdTable(&cmdTab);
+	if(parse(buf, &cmdTab))
+		freeCmdTable(&cmdTab);
+}
+
+/**
+ * @brief Sets up and tears down a command table with an arena as large as
+ * parsing the line would need, without parsing it
+ * 
+ * @param line Command line
+ */
+static void initFreeOnce(const char *line) {
+	cmdTable cmdTab;
+
+	initCmdTable(&cmdTab);
+	arenaAlloc(&cmdTab.mem, 2 * ARENA_ALIGN(strlen(line) + 1));
+	freeCmdTable(&cmdTab);
+}
+
+/**
+ * @brief Runs an operation on a line in batches that double in size
+ * until a batch takes at least BENCH_MIN_TIME
+ * 
+ * @param name Benchmark
+ * @param variant Case of benchmark
+ * @param op Operation
+ * @param line Command line
+ */
+static void runMicro(const char *name, const char *variant, void (*op)(const char *), const char *line) {
+	long iterations = 1000;
+	double start, elapsed;
+
+	while(1) {
+		start = now();
+		for(long i = 0; i < iterations; i++)
+			op(line);
+		elapsed = now() - start;
+		if(elapsed >= BENCH_MIN_TIME)
+			break;
+		iterations *= 2;
+	}
+	report(name, variant, iterations, elapsed * 1e9 / iterations, "ns/op");
+}
+
+/**
+ * @brief Runs fsh on a script given with -c and times it
+ * 
+ * Output of fsh goes to /dev/null.
+ * 
+ * @param fsh Path of fsh
+ * @param script Command lines
+ * @return Seconds it took, -1 if fsh failed
+ */
+static double runFsh(const char *fsh, const char *script) {
+	double start = now();
+	int status, null;
+	pid_t pid;
+
+	if((pid = fork()) == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	if(pid == 0) {
+		if((null = open("/dev/null", O_WRONLY)) != -1) {
+			dup2(null, STDOUT_FILENO);
+			close(null);
+		}
+		execl(fsh, "fsh", "-c", script, (char *)NULL);
+		perror(fsh);
+		_exit(127);
+	}
+
+	if(waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "fsh-bench: fsh failed on: %.60s\n", script);
+		return -1;
+	}
+	return now() - start;
+}
+
+/**
+ * @brief Builds a script repeating one line
+ * 
+ * @param line Command line
+ * @param times Number of repetitions
+ * @return Script, to be freed
+ */
+static char *repeat(const char *line, int times) {
+	size_t len = strlen(line);
+	char *script = malloc(times * (len + 1) + 1), *p = script;
+
+	if(script == NULL) {
+		perror("fsh-bench");
+		exit(EXIT_FAILURE);
+	}
+	for(int i = 0; i < times; i++) {
+		p = mempcpy(p, line, len);
+		*p++ = '\n';
+	}
+	*p = '\0';
+	return script;
+}
+
+/**
+ * @brief Measures how many times per second fsh runs a command
+ * 
+ * @param fsh Path of fsh
+ * @param variant Case of benchmark
+ * @param line Command line
+ */
+static void benchCommands(const char *fsh, const char *variant, const char *line) {
+	char *script = repeat(line, BENCH_COMMANDS);
+	double elapsed = runFsh(fsh, script);
+
+	if(elapsed > 0)
+		report("commands", variant, BENCH_COMMANDS, BENCH_COMMANDS / elapsed, "commands/s");
+	free(script);
+}
+
+/**
+ * @brief Measures the time fsh takes to run a pipeline of cat's with
+ * nothing to copy, from launching the first stage to reaping the last
+ * 
+ * cat is named by its path, so a single stage is executed too rather
+ * than copied by the shell.
+ * 
+ * @param fsh Path of fsh
+ * @param cat Path of cat
+ * @param stages Number of stages
+ */
+static void benchPipeline(const char *fsh, const char *cat, int stages) {
+	char line[32 * BENCH_MAX_STAGES], variant[32];
+	char *script;
+	double elapsed;
+
+	snprintf(line, sizeof(line), "%s < /dev/null", cat);
+	for(int i = 1; i < stages; i++) {
+		strcat(line, " | ");
+		strcat(line, cat);
+	}
+	script = repeat(line, BENCH_PIPELINES);
+
+	snprintf(variant, sizeof(variant), "%d-stages", stages);
+	if((elapsed = runFsh(fsh, script)) > 0)
+		report("pipeline-latency", variant, BENCH_PIPELINES, elapsed * 1e6 / BENCH_PIPELINES, "us");
+	free(script);
+}
+
+/**
+ * @brief Measures throughput of a chain of cat's fed from /dev/zero
+ * 
+ * @param fsh Path of fsh
+ */
+static void benchChain(const char *fsh) {
+	char line[256], variant[32];
+	double elapsed;
+	int len;
+
+	len = snprintf(line, sizeof(line), "head -c %ld /dev/zero", BENCH_CHAIN_BYTES);
+	for(int i = 0; i < BENCH_CHAIN_CATS; i++)
+		len += snprintf(line + len, sizeof(line) - len, " | cat");
+	snprintf(line + len, sizeof(line) - len, " > /dev/null");
+
+	snprintf(variant, sizeof(variant), "%d-cats", BENCH_CHAIN_CATS);
+	if((elapsed = runFsh(fsh, line)) > 0)
+		report("chain-throughput", variant, BENCH_CHAIN_BYTES, BENCH_CHAIN_BYTES / elapsed / (1 << 20), "MiB/s");
+}
+
+/**
+ * @brief Runs the benchmarks
+ * 
+ * "fsh-bench" runs the microbenchmarks of parsing, "fsh-bench path/to/fsh"
+ * also runs fsh itself. Every result is a line of JSON on standard output.
+ * 
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return 0
+ */
+int main(int argc, char *argv[]) {
+	const char *trueCmd = access("/bin/true", X_OK) == 0 ? "/bin/true" : "/usr/bin/true";
+	const char *catCmd = access("/bin/cat", X_OK) == 0 ? "/bin/cat" : "/usr/bin/cat";
+
+	for(size_t i = 0; i < sizeof(corpus) / sizeof(corpus[0]); i++) {
+		runMicro("parse", corpus[i].name, parseOnce, corpus[i].line);
+		runMicro("init-free", corpus[i].name, initFreeOnce, corpus[i].line);
+	}
+
+	if(argc < 2)
+		return 0;
+
+	benchCommands(argv[1], "builtin-true", "true");
+	benchCommands(argv[1], "external-true", trueCmd);
+	for(int stages = 1; stages <= BENCH_MAX_STAGES; stages *= 2)
+		benchPipeline(argv[1], catCmd, stages);
+	benchChain(argv[1]);
+	return 0;
+}
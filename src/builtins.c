@@ -0,0 +1,982 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "shell.h"
+#include "hash.h"
+#include "input.h"
+#include "parallel.h"
+#include "builtins.h"
+#include "stream.h"
+#include "history.h"
+#include "cache.h"
+#include "jobsched.h"
+#include "events.h"
+#include "trace.h"
+#include "stats.h"
+#include "wildcard.h"
+
+/**
+ * @brief Changes the working directory, to HOME if none is given
+ * 
+ */
+static int builtinCd(char **argv, cmdTable *cmdTab) {
+	char *dir = argv[1] ? argv[1] : getenv("HOME");
+
+	if(dir == NULL) {
+		fprintf(stderr, "cd: HOME not set\n");
+		return 1;
+	}
+	if(chdir(dir) == -1) {
+		perror("cd");
+		return 1;
+	}
+	if(interactive)
+		updatePrompt();
+	return 0;
+}
+
+/**
+ * @brief Makes the shell exit after this command line
+ * 
+ */
+static int builtinExit(char **argv, cmdTable *cmdTab) {
+	exitRequested = true;
+	return argv[1] ? atoi(argv[1]) : lastStatus;
+}
+
+/**
+ * @brief Brings the last job to foreground
+ * 
+ */
+static int builtinFg(char **argv, cmdTable *cmdTab) {
+	fg();
+	return 0;
+}
+
+/**
+ * @brief Continues the most recent stopped job in background
+ * 
+ */
+static int builtinBg(char **argv, cmdTable *cmdTab) {
+	bg();
+	return 0;
+}
+
+/**
+ * @brief Lists jobs, with their CPU time and memory after -l
+ * 
+ */
+static int builtinJobs(char **argv, cmdTable *cmdTab) {
+	if(argv[1] == NULL) {
+		printJobsTable(false);
+		return 0;
+	}
+	if(strcmp(argv[1], "-l") == 0 && argv[2] == NULL) {
+		printJobsTable(true);
+		return 0;
+	}
+	fprintf(stderr, "usage: jobs [-l]\n");
+	return 2;
+}
+
+/**
+ * @brief Finds the job named by an argument like %2 or 2
+ * 
+ * @param name Name of the builtin, for messages
+ * @param arg Job ID, NULL for the most recent job
+ * @return Pointer to job, NULL if there is no such job
+ */
+static job *jobArg(const char *name, const char *arg) {
+	char *end;
+	long id;
+	job *j;
+
+	if(arg == NULL) {
+		if((j = lastJob()) == NULL)
+			fprintf(stderr, "%s: no current job\n", name);
+		return j;
+	}
+	id = strtol(arg + (arg[0] == '%'), &end, 10);
+	if(end == arg + (arg[0] == '%') || *end || (j = getJob(id)) == NULL) {
+		fprintf(stderr, "%s: %s: no such job\n", name, arg);
+		return NULL;
+	}
+	return j;
+}
+
+/**
+ * @brief Applies settings to a running job
+ * 
+ * @param name Name of the builtin, for messages
+ * @param spec Pointer to settings
+ * @param arg Job ID, NULL for the most recent job
+ * @return Exit status of the builtin
+ */
+static int schedJob(const char *name, const schedSpec *spec, const char *arg) {
+	job *j = jobArg(name, arg);
+
+	if(j == NULL)
+		return 1;
+	if(setJobSched(j, spec) == -1) {
+		perror(name);
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Changes the CPUs, nice value or I/O priority of a running job
+ * 
+ */
+static int builtinRenice(char **argv, cmdTable *cmdTab) {
+	arena mem = { NULL };
+	schedSpec spec;
+	int taken, status = 2;
+
+	taken = parseSchedOptions(argv + 1, "renice", &mem, &spec);
+	if(taken != -1 && spec.flags && (argv[taken + 1] == NULL || argv[taken + 2] == NULL))
+		status = schedJob("renice", &spec, argv[taken + 1]);
+	else if(taken != -1)
+		fprintf(stderr, "usage: renice [-c cpus[/cpus...]] [-n nice] [-i class[:level]] [job]\n");
+	arenaFree(&mem);
+	return status;
+}
+
+/**
+ * @brief Moves the processes of a running job to other CPUs, one list
+ * for each of its stages
+ * 
+ */
+static int builtinPin(char **argv, cmdTable *cmdTab) {
+	arena mem = { NULL };
+	schedSpec spec = { 0 };
+	int status = 2;
+
+	if(argv[1] == NULL || (argv[2] && argv[3]))
+		fprintf(stderr, "usage: pin cpus[/cpus...] [job]\n");
+	else if(!parseCpus(argv[1], &mem, &spec))
+		fprintf(stderr, "pin: %s: invalid CPU list\n", argv[1]);
+	else
+		status = schedJob("pin", &spec, argv[2]);
+	arenaFree(&mem);
+	return status;
+}
+
+/**
+ * @brief Tells whether a job still has to be waited for
+ * 
+ * @param j Pointer to job
+ * @return true if some of its processes are running
+ */
+static bool isRunning(job *j) {
+	return j->numProcs > 0 && j->status != STOPPED;
+}
+
+/**
+ * @brief Tells whether the shell has children at all, so that a wait
+ * can end, which is not the case in a child running a builtin
+ * 
+ * @return true if there is a child that was not reaped yet
+ */
+static bool hasChildren() {
+	siginfo_t info;
+	return waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOHANG | WNOWAIT) == 0;
+}
+
+/**
+ * @brief Exit status a wait reports for a job
+ * 
+ * @param j Pointer to job
+ * @return Status of the job, 128 plus SIGTSTP if it is stopped
+ */
+static int waitStatus(job *j) {
+	return j->status == STOPPED ? 128 + SIGTSTP : jobStatus(j);
+}
+
+/**
+ * @brief Handler for SIGINT while waiting, which only ends the wait
+ * 
+ */
+static void interruptWait(int signum) {
+	ssize_t written = write(STDOUT_FILENO, "\n", 1);
+	(void)written;
+}
+
+/**
+ * @brief Waits for every background job, including the tasks parallel
+ * has yet to start
+ * 
+ * @return 0 once they completed, 130 if the wait was interrupted
+ */
+static int waitAll() {
+	int i;
+
+	while(1) {
+		reapChildren();
+		pollParallel();
+		for(i = 0; i < jobsTableIdx; i++)
+			if(jobsTable[i] && jobsTable[i]->status == BG && isRunning(jobsTable[i]))
+				break;
+		if(i == jobsTableIdx || !hasChildren())
+			return 0;
+		if(!waitChildren())
+			return 128 + SIGINT;
+	}
+}
+
+/**
+ * @brief Waits for each of a set of jobs in turn, or for any of them
+ * 
+ * Jobs are only removed from the main loop, so the pointers stay valid
+ * while waiting.
+ * 
+ * @param jobs Array of pointers to jobs
+ * @param numJobs Number of jobs in array
+ * @param any Whether to return once any of them completed
+ * @return Status of the last job, or of the one that completed, 127 if
+ * there is none, 130 if the wait was interrupted
+ */
+static int waitJobs(job **jobs, int numJobs, bool any) {
+	int i = 0;
+
+	if(numJobs == 0)
+		return 127;
+
+	while(1) {
+		reapChildren();
+		if(any) {
+			for(i = 0; i < numJobs && isRunning(jobs[i]); i++)
+				;
+			if(i < numJobs)
+				return waitStatus(jobs[i]);
+		}
+		else {
+			while(i < numJobs && !isRunning(jobs[i]))
+				i++;
+			if(i == numJobs)
+				return waitStatus(jobs[numJobs - 1]);
+		}
+
+		if(!hasChildren())
+			return 127;
+		if(!waitChildren())
+			return 128 + SIGINT;
+	}
+}
+
+/**
+ * @brief Waits for background jobs to complete
+ * 
+ * "wait" waits for every background job and returns 0. "wait %1 %2"
+ * waits for each of the jobs in turn and returns the status of the last
+ * one, "wait -n" for whichever of them, or of all running jobs, completes
+ * first and returns its status. Children are reaped by reapChildren as
+ * the event loop sees them exit, exactly as between command lines, so
+ * nothing is polled. Ctrl-C ends the wait with status 130.
+ * 
+ */
+static int builtinWait(char **argv, cmdTable *cmdTab) {
+	struct sigaction sa = { .sa_handler = interruptWait }, old;
+	bool any = argv[1] && strcmp(argv[1], "-n") == 0;
+	char **ids = argv + 1 + any;
+	int numJobs, status;
+	job **jobs = NULL;
+
+	for(int i = 0; ids[i]; i++) {
+		if(ids[i][0] == '-') {
+			fprintf(stderr, "usage: wait [-n] [job...]\n");
+			return 2;
+		}
+	}
+
+	/* The given jobs, or every running one for -n */
+	for(numJobs = 0; ids[numJobs]; numJobs++)
+		;
+	if(numJobs || any) {
+		jobs = malloc((numJobs ? numJobs : jobsTableIdx + 1) * sizeof(job *));
+		if(jobs == NULL) {
+			perror("wait");
+			exit(EXIT_FAILURE);
+		}
+		for(int i = 0; i < numJobs; i++) {
+			if((jobs[i] = jobArg("wait", ids[i])) == NULL) {
+				free(jobs);
+				return 127;
+			}
+		}
+		if(numJobs == 0) {
+			for(int i = 0; i < jobsTableIdx; i++)
+				if(jobsTable[i] && isRunning(jobsTable[i]))
+					jobs[numJobs++] = jobsTable[i];
+		}
+	}
+
+	if(interactive)
+		sigaction(SIGINT, &sa, &old);
+	status = jobs ? waitJobs(jobs, numJobs, any) : waitAll();
+	if(interactive)
+		sigaction(SIGINT, &old, NULL);
+
+	free(jobs);
+	return status;
+}
+
+/**
+ * @brief Lists remembered command locations, or forgets them with -r
+ * 
+ */
+static int builtinHash(char **argv, cmdTable *cmdTab) {
+	if(argv[1] == NULL) {
+		printHashTable();
+		return 0;
+	}
+	if(strcmp(argv[1], "-r") == 0 && argv[2] == NULL) {
+		clearHashTable();
+		return 0;
+	}
+	fprintf(stderr, "usage: hash [-r]\n");
+	return 2;
+}
+
+/**
+ * @brief Lists the history, its last n entries, or the entries starting
+ * with a prefix (-p) or containing a text (-s)
+ * 
+ */
+static int builtinHistory(char **argv, cmdTable *cmdTab) {
+	char *end;
+	long count;
+
+	if(argv[1] == NULL) {
+		printHistory(0);
+		return 0;
+	}
+	if((strcmp(argv[1], "-p") == 0 || strcmp(argv[1], "-s") == 0) && argv[2] && argv[2][0] && argv[3] == NULL)
+		return searchHistory(argv[2], argv[1][1] == 'p') ? 0 : 1;
+
+	count = strtol(argv[1], &end, 10);
+	if(*end == '\0' && count > 0 && argv[2] == NULL) {
+		printHistory(count);
+		return 0;
+	}
+	fprintf(stderr, "usage: history [n | -p prefix | -s text]\n");
+	return 2;
+}
+
+/**
+ * @brief Shows the counters of the parse cache, or empties it with -r
+ * 
+ */
+static int builtinParsecache(char **argv, cmdTable *cmdTab) {
+	if(argv[1] == NULL) {
+		printCacheStats();
+		return 0;
+	}
+	if(strcmp(argv[1], "-r") == 0 && argv[2] == NULL) {
+		clearCache();
+		return 0;
+	}
+	fprintf(stderr, "usage: parsecache [-r]\n");
+	return 2;
+}
+
+/**
+ * @brief Shows or sets the capacity of the pipes of new jobs
+ * 
+ */
+static int builtinPipesize(char **argv, cmdTable *cmdTab) {
+	char *end;
+	long size;
+	int capacity;
+
+	if(argv[1] == NULL) {
+		if((capacity = setPipeSize(pipeSize)) == -1) {
+			perror("pipesize");
+			return 1;
+		}
+		printf("%d%s\n", capacity, pipeSize ? "" : " (default)");
+		return 0;
+	}
+
+	size = strtol(argv[1], &end, 10);
+	if(*end == 'k' || *end == 'K')
+		size <<= 10, end++;
+	else if(*end == 'm' || *end == 'M')
+		size <<= 20, end++;
+	if(argv[1][0] == '\0' || *end != '\0' || argv[2]) {
+		fprintf(stderr, "usage: pipesize [bytes[k|m]]\n");
+		return 2;
+	}
+	if(setPipeSize(size) == -1) {
+		perror("pipesize");
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Records a timeline of the shell and its children to a file, stops
+ * recording with -s, or tells where it goes
+ * 
+ */
+static int builtinTrace(char **argv, cmdTable *cmdTab) {
+	if(argv[1] == NULL) {
+		printTraceStatus();
+		return 0;
+	}
+	if(argv[2] == NULL && strcmp(argv[1], "-s") == 0) {
+		stopTrace();
+		return 0;
+	}
+	if(argv[2] == NULL && argv[1][0] != '-') {
+		if(startTrace(argv[1]) == -1) {
+			perror(argv[1]);
+			return 1;
+		}
+		return 0;
+	}
+	fprintf(stderr, "usage: trace [file | -s]\n");
+	return 2;
+}
+
+/**
+ * @brief Prints the counters and latency percentiles of the shell, or
+ * clears them with --reset
+ * 
+ */
+static int builtinStats(char **argv, cmdTable *cmdTab) {
+	if(argv[1] == NULL) {
+		printStats();
+		return 0;
+	}
+	if(strcmp(argv[1], "--reset") == 0 && argv[2] == NULL) {
+		resetStats();
+		return 0;
+	}
+	fprintf(stderr, "usage: stats [--reset]\n");
+	return 2;
+}
+
+/**
+ * @brief Runs the parallel builtin, which does its own redirections
+ * 
+ */
+static int builtinParallel(char **argv, cmdTable *cmdTab) {
+	parallel(argv, cmdTab);
+	return lastStatus;
+}
+
+/**
+ * @brief Does nothing successfully
+ * 
+ */
+static int builtinTrue(char **argv, cmdTable *cmdTab) {
+	return 0;
+}
+
+/**
+ * @brief Does nothing unsuccessfully
+ * 
+ */
+static int builtinFalse(char **argv, cmdTable *cmdTab) {
+	return 1;
+}
+
+/**
+ * @brief Prints the arguments, without a newline after -n
+ * 
+ */
+static int builtinEcho(char **argv, cmdTable *cmdTab) {
+	bool newline = true;
+
+	argv++;
+	if(*argv && strcmp(*argv, "-n") == 0) {
+		newline = false;
+		argv++;
+	}
+	for(; *argv; argv++) {
+		fputs(*argv, stdout);
+		if(argv[1])
+			putchar(' ');
+	}
+	if(newline)
+		putchar('\n');
+	return 0;
+}
+
+/**
+ * @brief Prints the working directory
+ * 
+ */
+static int builtinPwd(char **argv, cmdTable *cmdTab) {
+	char cwd[PATH_MAX];
+
+	if(getcwd(cwd, sizeof(cwd)) == NULL) {
+		perror("pwd");
+		return 1;
+	}
+	puts(cwd);
+	return 0;
+}
+
+/**
+ * @brief Decodes a backslash escape
+ * 
+ * @param s Characters after the backslash
+ * @param c Set to the character it stands for
+ * @return Pointer past the escape
+ */
+static const char *unescape(const char *s, char *c) {
+	int value = 0, digits = 0;
+
+	switch(*s) {
+	case 'a': *c = '\a'; return s + 1;
+	case 'b': *c = '\b'; return s + 1;
+	case 'f': *c = '\f'; return s + 1;
+	case 'n': *c = '\n'; return s + 1;
+	case 'r': *c = '\r'; return s + 1;
+	case 't': *c = '\t'; return s + 1;
+	case 'v': *c = '\v'; return s + 1;
+	case '\\': *c = '\\'; return s + 1;
+	case '\0': *c = '\\'; return s;
+	}
+
+	/* Octal value of up to three digits, after a 0 for %b */
+	if(*s == '0')
+		s++;
+	while(digits < 3 && *s >= '0' && *s <= '7') {
+		value = value * 8 + (*s++ - '0');
+		digits++;
+	}
+	if(digits == 0 && s[-1] != '0') {
+		*c = '\\';
+		return s;
+	}
+	*c = value;
+	return s;
+}
+
+/**
+ * @brief Prints a string, decoding its backslash escapes
+ * 
+ * @param s String
+ */
+static void printEscaped(const char *s) {
+	char c;
+
+	while(*s) {
+		if(*s == '\\') {
+			s = unescape(s + 1, &c);
+			putchar(c);
+		}
+		else {
+			putchar(*s++);
+		}
+	}
+}
+
+/**
+ * @brief Converts an argument of printf to a number
+ * 
+ * @param arg Argument, NULL for a missing one which is 0
+ * @param end First character after the number
+ * @return true if all of arg is a number
+ */
+static bool numericArg(const char *arg, char *end) {
+	if(arg == NULL || *end == '\0')
+		return true;
+	fprintf(stderr, "printf: %s: invalid number\n", arg);
+	return false;
+}
+
+/**
+ * @brief Formats and prints its arguments
+ * 
+ * Supports the conversions of printf(1) with flags, width and precision,
+ * and %b for a string with escapes. The format is used again as long as
+ * it consumes arguments.
+ * 
+ */
+static int builtinPrintf(char **argv, cmdTable *cmdTab) {
+	char spec[32], conv, *end = "", c;
+	char **arg = &argv[2], **passStart;
+	const char *format = argv[1], *p, *val;
+	size_t len;
+	int status = 0;
+
+	if(format == NULL) {
+		fprintf(stderr, "usage: printf format [arguments]\n");
+		return 2;
+	}
+
+	do {
+		passStart = arg;
+		for(p = format; *p; p++) {
+			if(*p == '\\') {
+				p = unescape(p + 1, &c) - 1;
+				putchar(c);
+				continue;
+			}
+			if(*p != '%') {
+				putchar(*p);
+				continue;
+			}
+			if(p[1] == '%') {
+				putchar('%');
+				p++;
+				continue;
+			}
+
+			/* Keep flags, width and precision, adding a length modifier */
+			len = strspn(p + 1, "-+ #0123456789.") + 1;
+			conv = p[len];
+			if(conv == '\0' || len + 4 > sizeof(spec)) {
+				fprintf(stderr, "printf: %s: invalid format\n", format);
+				return 1;
+			}
+			memcpy(spec, p, len);
+			p += len;
+			val = *arg ? *arg++ : NULL;
+
+			switch(conv) {
+			case 'd': case 'i':
+				strcpy(spec + len, "lld");
+				printf(spec, val ? strtoll(val, &end, 0) : 0LL);
+				status |= !numericArg(val, end);
+				break;
+			case 'u': case 'o': case 'x': case 'X':
+				spec[len] = 'l';
+				spec[len + 1] = 'l';
+				spec[len + 2] = conv;
+				spec[len + 3] = '\0';
+				printf(spec, val ? strtoull(val, &end, 0) : 0ULL);
+				status |= !numericArg(val, end);
+				break;
+			case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+				spec[len] = conv;
+				spec[len + 1] = '\0';
+				printf(spec, val ? strtod(val, &end) : 0.0);
+				status |= !numericArg(val, end);
+				break;
+			case 'c':
+				strcpy(spec + len, "c");
+				if(val && *val)
+					printf(spec, *val);
+				break;
+			case 's':
+				strcpy(spec + len, "s");
+				printf(spec, val ? val : "");
+				break;
+			case 'b':
+				printEscaped(val ? val : "");
+				break;
+			default:
+				fprintf(stderr, "printf: %%%c: invalid conversion\n", conv);
+				return 1;
+			}
+		}
+	} while(*arg && arg != passStart);
+
+	return status;
+}
+
+/**
+ * @brief Parses an integer operand of test
+ * 
+ * @param s Operand
+ * @param value Set to its value
+ * @return true if s is an integer
+ */
+static bool testInteger(const char *s, long long *value) {
+	char *end;
+
+	errno = 0;
+	*value = strtoll(s, &end, 10);
+	if(*s == '\0' || *end != '\0' || errno) {
+		fprintf(stderr, "test: %s: integer expression expected\n", s);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Evaluates a unary expression of test
+ * 
+ * @param op Operator such as -f
+ * @param arg Operand
+ * @return 0 if true, 1 if false, 2 for an unknown operator
+ */
+static int testUnary(const char *op, const char *arg) {
+	struct stat sb;
+
+	if(op[0] != '-' || op[1] == '\0' || op[2] != '\0') {
+		fprintf(stderr, "test: %s: unary operator expected\n", op);
+		return 2;
+	}
+
+	switch(op[1]) {
+	case 'n': return arg[0] == '\0';
+	case 'z': return arg[0] != '\0';
+	case 'r': return access(arg, R_OK) != 0;
+	case 'w': return access(arg, W_OK) != 0;
+	case 'x': return access(arg, X_OK) != 0;
+	case 't': return !isatty(atoi(arg));
+	case 'h': case 'L':
+		return lstat(arg, &sb) != 0 || !S_ISLNK(sb.st_mode);
+	}
+
+	if(strchr("efdsbcpSug", op[1]) == NULL) {
+		fprintf(stderr, "test: %s: unary operator expected\n", op);
+		return 2;
+	}
+	if(stat(arg, &sb) != 0)
+		return 1;
+
+	switch(op[1]) {
+	case 'e': return 0;
+	case 'f': return !S_ISREG(sb.st_mode);
+	case 'd': return !S_ISDIR(sb.st_mode);
+	case 's': return sb.st_size == 0;
+	case 'b': return !S_ISBLK(sb.st_mode);
+	case 'c': return !S_ISCHR(sb.st_mode);
+	case 'p': return !S_ISFIFO(sb.st_mode);
+	case 'S': return !S_ISSOCK(sb.st_mode);
+	case 'u': return !(sb.st_mode & S_ISUID);
+	default:  return !(sb.st_mode & S_ISGID);
+	}
+}
+
+/**
+ * @brief Tells whether a word is a binary operator of test
+ * 
+ * @param op Word
+ * @return true if it is one
+ */
+static bool isBinaryOp(const char *op) {
+	static const char *ops[] = { "=", "==", "!=", "-eq", "-ne", "-lt", "-le", "-gt", "-ge", NULL };
+
+	for(int i = 0; ops[i]; i++)
+		if(strcmp(op, ops[i]) == 0)
+			return true;
+	return false;
+}
+
+/**
+ * @brief Evaluates a binary expression of test
+ * 
+ * @return 0 if true, 1 if false, 2 if an operand is not an integer
+ */
+static int testBinary(const char *a, const char *op, const char *b) {
+	long long x, y;
+
+	if(op[0] != '-')
+		return (strcmp(a, b) == 0) == (op[0] == '!');
+	if(!testInteger(a, &x) || !testInteger(b, &y))
+		return 2;
+
+	if(strcmp(op, "-eq") == 0) return !(x == y);
+	if(strcmp(op, "-ne") == 0) return !(x != y);
+	if(strcmp(op, "-lt") == 0) return !(x < y);
+	if(strcmp(op, "-le") == 0) return !(x <= y);
+	if(strcmp(op, "-gt") == 0) return !(x > y);
+	return !(x >= y);
+}
+
+/**
+ * @brief Negates a result of test, keeping errors
+ * 
+ */
+static int testNot(int result) {
+	return result == 2 ? 2 : !result;
+}
+
+/**
+ * @brief Evaluates an expression of test by its number of arguments, as
+ * POSIX specifies it
+ * 
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return 0 if true, 1 if false, 2 on error
+ */
+static int evalTest(int argc, char **argv) {
+	switch(argc) {
+	case 0:
+		return 1;
+	case 1:
+		return argv[0][0] == '\0';
+	case 2:
+		if(strcmp(argv[0], "!") == 0)
+			return testNot(evalTest(1, argv + 1));
+		return testUnary(argv[0], argv[1]);
+	case 3:
+		if(isBinaryOp(argv[1]))
+			return testBinary(argv[0], argv[1], argv[2]);
+		if(strcmp(argv[0], "!") == 0)
+			return testNot(evalTest(2, argv + 1));
+		if(strcmp(argv[0], "(") == 0 && strcmp(argv[2], ")") == 0)
+			return evalTest(1, argv + 1);
+		fprintf(stderr, "test: %s: binary operator expected\n", argv[1]);
+		return 2;
+	case 4:
+		if(strcmp(argv[0], "!") == 0)
+			return testNot(evalTest(3, argv + 1));
+		if(strcmp(argv[0], "(") == 0 && strcmp(argv[3], ")") == 0)
+			return evalTest(2, argv + 1);
+		/* Fall through */
+	default:
+		fprintf(stderr, "test: too many arguments\n");
+		return 2;
+	}
+}
+
+/**
+ * @brief Evaluates a conditional expression, as test or as [ ... ]
+ * 
+ */
+static int builtinTest(char **argv, cmdTable *cmdTab) {
+	int argc = 0;
+
+	while(argv[argc])
+		argc++;
+
+	if(strcmp(argv[0], "[") == 0) {
+		if(strcmp(argv[argc - 1], "]") != 0) {
+			fprintf(stderr, "[: missing ]\n");
+			return 2;
+		}
+		argc--;
+	}
+	return evalTest(argc - 1, argv + 1);
+}
+
+/* Builtins sorted by name for bsearch */
+static const builtin builtins[] = {
+	{ "[",          builtinTest,       0 },
+	{ "bg",         builtinBg,         0 },
+	{ "cd",         builtinCd,         0 },
+	{ "echo",       builtinEcho,       0 },
+	{ "exit",       builtinExit,       0 },
+	{ "false",      builtinFalse,      0 },
+	{ "fg",         builtinFg,         0 },
+	{ "hash",       builtinHash,       0 },
+	{ "history",    builtinHistory,    0 },
+	{ "jobs",       builtinJobs,       0 },
+	{ "parallel",   builtinParallel,   BUILTIN_WHOLE_LINE },
+	{ "parsecache", builtinParsecache, 0 },
+	{ "pin",        builtinPin,        0 },
+	{ "pipesize",   builtinPipesize,   0 },
+	{ "printf",     builtinPrintf,     0 },
+	{ "pwd",        builtinPwd,        0 },
+	{ "renice",     builtinRenice,     0 },
+	{ "stats",      builtinStats,      0 },
+	{ "test",       builtinTest,       0 },
+	{ "trace",      builtinTrace,      0 },
+	{ "true",       builtinTrue,       0 },
+	{ "wait",       builtinWait,       0 },
+};
+
+/**
+ * @brief Compares a name with the name of a builtin, for bsearch
+ * 
+ */
+static int compareBuiltin(const void *name, const void *b) {
+	return strcmp(name, ((const builtin *)b)->name);
+}
+
+/**
+ * @brief Looks up a builtin by name
+ * 
+ * @param name Command name
+ * @return Pointer to builtin, NULL if there is none with that name
+ */
+const builtin *findBuiltin(const char *name) {
+	return bsearch(name, builtins, sizeof(builtins) / sizeof(builtins[0]), sizeof(builtin), compareBuiltin);
+}
+
+/**
+ * @brief Points a standard descriptor of the shell to an open file
+ * 
+ * @param fd Standard descriptor
+ * @param filefd Descriptor of file, closed, -1 if it could not be opened
+ * @param name Name to prefix the message with on failure
+ * @param saved Set to a copy of what fd was, -1 if it was closed
+ * @return true on success
+ */
+static bool redirect(int fd, int filefd, const char *name, int *saved) {
+	if(filefd == -1) {
+		perror(name);
+		return false;
+	}
+	*saved = fcntl(fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+	dup2(filefd, fd);
+	close(filefd);
+	return true;
+}
+
+/**
+ * @brief Points a standard descriptor back to what it was
+ * 
+ * @param fd Standard descriptor
+ * @param saved Copy from redirect
+ */
+static void restore(int fd, int saved) {
+	if(saved == -1) {
+		close(fd);
+		return;
+	}
+	dup2(saved, fd);
+	close(saved);
+}
+
+/**
+ * @brief Runs a builtin in the shell process
+ * 
+ * Redirections are applied to the shell's own standard input and output
+ * and undone afterwards, so no process is needed even for "echo > file".
+ * Output buffered by stdio is flushed on both sides of the switch.
+ * 
+ * @param b Pointer to builtin
+ * @param cmdTab Pointer to command table, released afterwards
+ * @return Exit status of builtin
+ */
+int runBuiltin(const builtin *b, cmdTable *cmdTab) {
+	int savedIn = -1, savedOut = -1, status = 1;
+	bool in = false, out = false;
+	arena mem = { NULL };
+	char **argv;
+
+	/* Those keep the words past their return, and expand them themselves */
+	if(b->flags & BUILTIN_WHOLE_LINE)
+		return b->func(cmdTab->args[0], cmdTab);
+
+	argv = cmdTab->globs ? expandWildcards(cmdTab->args[0], &mem) : cmdTab->args[0];
+	fflush(stdout);
+	/* A here-document takes the place of the input file, as for a job */
+	if(cmdTab->heredoc || cmdTab->heredocEnd)
+		in = redirect(STDIN_FILENO, openHeredoc(cmdTab), "heredoc", &savedIn);
+	else if(cmdTab->infile)
+		in = redirect(STDIN_FILENO, open(cmdTab->infile, READ_FLAGS | O_CLOEXEC, READ_MODES), cmdTab->infile, &savedIn);
+	if((in || (cmdTab->heredoc == NULL && cmdTab->heredocEnd == NULL && cmdTab->infile == NULL)) &&
+	   (cmdTab->outfile == NULL ||
+	    (out = redirect(STDOUT_FILENO, open(cmdTab->outfile, CREATE_FLAGS | O_CLOEXEC, CREATE_MODES), cmdTab->outfile, &savedOut)))) {
+		status = b->func(argv, cmdTab);
+		fflush(stdout);
+	}
+
+	if(out)
+		restore(STDOUT_FILENO, savedOut);
+	if(in)
+		restore(STDIN_FILENO, savedIn);
+
+	arenaFree(&mem);
+	releaseCmdTable(cmdTab);
+	return status;
+}
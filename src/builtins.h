@@ -0,0 +1,30 @@
+/* Flags of a builtin */
+/* Takes over the command table and opens its redirection files itself */
+#define BUILTIN_WHOLE_LINE 1
+
+/**
+ * Command run by the shell itself, looked up by its name
+ */
+typedef struct {
+	const char *name;
+	/* Runs the builtin with the arguments of its command, returns its exit status */
+	int (*func)(char **argv, cmdTable *cmdTab);
+	int flags;
+} builtin;
+
+/**
+ * Look up a builtin
+ * @param name command name
+ * @return pointer to builtin, NULL if there is none with that name
+ */
+const builtin *findBuiltin(const char *name);
+
+/**
+ * Run a builtin that is a command line of its own in the shell process,
+ * with its redirections applied to the shell's standard input and output
+ * for as long as it runs
+ * @param b pointer to builtin
+ * @param cmdTab pointer to command table, released afterwards
+ * @return exit status of builtin
+ */
+int runBuiltin(const builtin *b, cmdTable *cmdTab);
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "parse.h"
+#include "cache.h"
+#include "stats.h"
+
+/* Hash chains of kept lines, and the ends of the list from most to least
+   recently used */
+static cacheEntry *cacheTable[CACHE_BUCKETS];
+static cacheEntry *newest = NULL;
+static cacheEntry *oldest = NULL;
+static int cacheCount = 0;
+
+/* Lookups that found the line parsed, lookups that parsed it, and lines
+   dropped to make room */
+static unsigned long cacheHits = 0;
+static unsigned long cacheMisses = 0;
+static unsigned long cacheEvictions = 0;
+
+/**
+ * @brief FNV-1a hash of a command line
+ * 
+ * @param line Command line
+ * @param len Set to the length of the line
+ * @return Hash value
+ */
+static size_t hashLine(const char *line, size_t *len) {
+	const char *c = line;
+	size_t hash = 2166136261u;
+
+	while(*c) {
+		hash ^= (unsigned char)*c++;
+		hash *= 16777619u;
+	}
+	*len = c - line;
+	return hash;
+}
+
+/**
+ * @brief Takes an entry off the list of recently used entries
+ * 
+ * @param e Pointer to entry
+ */
+static void unlinkEntry(cacheEntry *e) {
+	if(e->newer)
+		e->newer->older = e->older;
+	else
+		newest = e->older;
+	if(e->older)
+		e->older->newer = e->newer;
+	else
+		oldest = e->newer;
+}
+
+/**
+ * @brief Puts an entry at the front of the list of recently used entries
+ * 
+ * @param e Pointer to entry
+ */
+static void pushEntry(cacheEntry *e) {
+	e->newer = NULL;
+	e->older = newest;
+	if(newest)
+		newest->newer = e;
+	else
+		oldest = e;
+	newest = e;
+}
+
+/**
+ * @brief Drops the least recently used entry
+ * 
+ */
+static void evictOldest() {
+	cacheEntry *e = oldest, **link = &cacheTable[e->hash & (CACHE_BUCKETS - 1)];
+
+	while(*link != e)
+		link = &(*link)->chain;
+	*link = e->chain;
+	unlinkEntry(e);
+
+	/* Jobs still running it keep their own reference */
+	releaseCmdList(e->list);
+	free(e);
+	cacheCount--;
+	cacheEvictions++;
+}
+
+/**
+ * @brief Parse a command line, or find it parsed already
+ * 
+ * The cache keeps a reference to every list it holds. A list and its
+ * tables are never changed once parsed, so the same ones are handed out
+ * for every run of the line and jobs share them instead of copying them.
+ * 
+ * @param cmdLine Command line
+ * @return Command list, to be released by the caller, NULL on a syntax error
+ */
+cmdList *parseCached(char *cmdLine) {
+	size_t len, hash = hashLine(cmdLine, &len);
+	cacheEntry *e, **bucket = &cacheTable[hash & (CACHE_BUCKETS - 1)];
+	cmdList *list;
+	long long started;
+
+	for(e = *bucket; e; e = e->chain) {
+		if(e->hash == hash && strcmp(e->list->cmdLine, cmdLine) == 0) {
+			cacheHits++;
+			unlinkEntry(e);
+			pushEntry(e);
+			return holdCmdList(e->list);
+		}
+	}
+
+	cacheMisses++;
+	started = statsNow();
+	list = parseList(cmdLine);
+	recordLatency(STAT_PARSE, started);
+	statCounters[COUNT_PARSED]++;
+	if(list == NULL)
+		return NULL;
+	if(len > CACHE_LINE_MAX || (e = malloc(sizeof(cacheEntry))) == NULL)
+		return list;
+
+	if(cacheCount == CACHE_SIZE)
+		evictOldest();
+	e->hash = hash;
+	e->list = holdCmdList(list);
+	e->chain = *bucket;
+	*bucket = e;
+	pushEntry(e);
+	cacheCount++;
+	return list;
+}
+
+/**
+ * @brief Print the number of lines kept and how often they were found
+ * 
+ */
+void printCacheStats() {
+	unsigned long lookups = cacheHits + cacheMisses;
+
+	printf("entries\t\t%d/%d\n", cacheCount, CACHE_SIZE);
+	printf("hits\t\t%lu\n", cacheHits);
+	printf("misses\t\t%lu\n", cacheMisses);
+	printf("evictions\t%lu\n", cacheEvictions);
+	printf("hit rate\t%.1f%%\n", lookups ? 100.0 * cacheHits / lookups : 0.0);
+}
+
+/**
+ * @brief Drop every line kept and reset the counters
+ * 
+ */
+void clearCache() {
+	while(oldest)
+		evictOldest();
+	cacheHits = cacheMisses = cacheEvictions = 0;
+}
@@ -0,0 +1,37 @@
+/* Number of parsed command lines kept */
+#define CACHE_SIZE 256
+
+/* Number of hash chains, a power of two */
+#define CACHE_BUCKETS 512
+
+/* Longer lines are parsed every time rather than kept */
+#define CACHE_LINE_MAX 4096
+
+/**
+ * Parsed command line kept in the cache, on a hash chain and on the list
+ * of entries from most to least recently used
+ */
+typedef struct cacheEntry {
+	size_t hash;
+	cmdList *list;
+	struct cacheEntry *chain;
+	struct cacheEntry *newer;
+	struct cacheEntry *older;
+} cacheEntry;
+
+/**
+ * Parse a command line, or find it parsed already
+ * @param cmdLine command line
+ * @return command list, to be released by the caller, NULL on a syntax error
+ */
+cmdList *parseCached(char *cmdLine);
+
+/**
+ * Print the number of lines kept and how often they were found
+ */
+void printCacheStats();
+
+/**
+ * Drop every line kept and reset the counters
+ */
+void clearCache();
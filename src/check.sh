@@ -0,0 +1,31 @@
+#!/bin/sh
+# Checks of the built shell, run by "make check" as: check.sh path/to/fsh
+
+fsh=${1:-./fsh}
+case $fsh in /*) ;; *) fsh=$PWD/$fsh ;; esac
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+failed=0
+
+# check name expected script: runs script with fsh -c in a scratch
+# directory, dropping the lines that report jobs
+check() {
+	actual=$(cd "$dir" && "$fsh" -c "$3" 2>&1 | grep -v '^\[')
+	if [ "$actual" = "$2" ]; then
+		echo "PASS: $1"
+	else
+		echo "FAIL: $1"
+		printf 'expected:\n%s\nactual:\n%s\n' "$2" "$actual"
+		failed=1
+	fi
+}
+
+touch "$dir/a.log" "$dir/b.log" "$dir/c.txt"
+
+check glob 'a.log b.log' 'echo *.log'
+check parallel-glob 'a.log
+b.log' 'parallel -j 1 echo ::: *.log'
+check parallel-glob-command 'c.txt a.log
+c.txt b.log' 'parallel -j 1 echo *.txt ::: *.log'
+
+exit $failed
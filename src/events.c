@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include "events.h"
+#include "stats.h"
+
+/* Set of everything the main loop waits on */
+static int epollFd = -1;
+
+/* SIGCHLD descriptor, for children that stop, and for every change of
+   state when pidfds are not available */
+static int sigFd = -1;
+
+/* Whether children are watched through pidfds */
+static bool havePidfds = false;
+
+/* Input descriptor in the set, and whether it could be added */
+static int inputFd = -1;
+static bool inputPollable = false;
+
+/**
+ * @brief Opens a pidfd for a process
+ * 
+ * @param pid Process ID
+ * @return pidfd, -1 on failure
+ */
+static int openPidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Creates the epoll set
+ * 
+ * SIGCHLD, which the caller keeps blocked, is read from a signalfd. A
+ * pidfd only becomes readable once its process has exited, so the
+ * signalfd is what wakes the loop when a background job is stopped by
+ * SIGTTIN or SIGTSTP. Pidfds are used as well when the kernel has them,
+ * probed on the shell's own pid. Called again in a forked child of the
+ * shell, it drops the set shared with the parent for one of its own.
+ * 
+ */
+void initEvents() {
+	struct epoll_event ev = { .events = EPOLLIN };
+	sigset_t chldMask;
+	int fd;
+
+	if(epollFd != -1)
+		close(epollFd);
+	if(sigFd != -1)
+		close(sigFd);
+	sigFd = -1;
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(epollFd == -1) {
+		perror("epoll_create1");
+		exit(EXIT_FAILURE);
+	}
+
+	if((havePidfds = (fd = openPidfd(getpid())) != -1))
+		close(fd);
+
+	sigemptyset(&chldMask);
+	sigaddset(&chldMask, SIGCHLD);
+	sigFd = signalfd(-1, &chldMask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if(sigFd == -1) {
+		perror("signalfd");
+		exit(EXIT_FAILURE);
+	}
+	ev.data.fd = sigFd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, sigFd, &ev);
+}
+
+/**
+ * @brief Watches a child for its exit
+ * 
+ * The pidfd is readable once the child has exited and leaves the set
+ * when the caller closes it after reaping the child.
+ * 
+ * @param pid Process ID of child
+ * @return pidfd, -1 if children are seen through the signalfd only
+ */
+int watchProcess(pid_t pid) {
+	struct epoll_event ev = { .events = EPOLLIN };
+	int fd;
+
+	if(!havePidfds)
+		return -1;
+
+	if((fd = openPidfd(pid)) == -1) {
+		perror("pidfd_open");
+		return -1;
+	}
+	ev.data.fd = fd;
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+	return fd;
+}
+
+/**
+ * @brief Watches the descriptor input is read from
+ * 
+ * Replaces the one watched before, if any.
+ * 
+ * @param fd Descriptor
+ * @return true if it can be waited on, false for e.g. a regular file
+ */
+bool watchInput(int fd) {
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	if(fd == inputFd)
+		return inputPollable;
+
+	if(inputPollable)
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, inputFd, NULL);
+	inputFd = fd;
+	ev.data.fd = fd;
+	inputPollable = epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) == 0;
+	return inputPollable;
+}
+
+/**
+ * @brief Blocks until input is ready or a child changed state
+ * 
+ * Pending SIGCHLDs are drained from the signalfd, the caller is expected
+ * to reap every child that is ready.
+ * 
+ * @return Mask of EVENT_INPUT and EVENT_CHILD
+ */
+int waitEvents() {
+	struct epoll_event events[MAX_EVENTS];
+	struct signalfd_siginfo info;
+	int n, seen = 0;
+
+	while((n = epoll_wait(epollFd, events, MAX_EVENTS, -1)) == -1) {
+		if(errno != EINTR) {
+			perror("epoll_wait");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for(int i = 0; i < n; i++) {
+		if(events[i].data.fd == inputFd) {
+			seen |= EVENT_INPUT;
+		}
+		else {
+			if(events[i].data.fd == sigFd)
+				while(read(sigFd, &info, sizeof(info)) == sizeof(info))
+					;
+			seen |= EVENT_CHILD;
+		}
+	}
+	if(seen & EVENT_CHILD)
+		childrenSeen = statsNow();
+	return seen;
+}
+
+/**
+ * @brief Blocks until a child changed state, leaving input for later
+ * 
+ * Input is taken out of the set while waiting, so that a line typed
+ * ahead does not wake the caller over and over.
+ * 
+ * @return true once a child changed state, false if a signal such as
+ * Ctrl-C interrupted the wait
+ */
+bool waitChildren() {
+	struct epoll_event events[MAX_EVENTS];
+	struct signalfd_siginfo info;
+	int n;
+
+	if(inputPollable)
+		epoll_ctl(epollFd, EPOLL_CTL_DEL, inputFd, NULL);
+	n = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+	if(n == -1 && errno != EINTR) {
+		perror("epoll_wait");
+		exit(EXIT_FAILURE);
+	}
+	if(inputPollable) {
+		struct epoll_event ev = { .events = EPOLLIN, .data.fd = inputFd };
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, inputFd, &ev);
+	}
+
+	for(int i = 0; i < n; i++)
+		if(events[i].data.fd == sigFd)
+			while(read(sigFd, &info, sizeof(info)) == sizeof(info))
+				;
+	if(n > 0)
+		childrenSeen = statsNow();
+	return n > 0;
+}
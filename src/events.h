@@ -0,0 +1,39 @@
+/* Maximum number of events taken from epoll at once */
+#define MAX_EVENTS 64
+
+/* What waitEvents saw happen */
+#define EVENT_INPUT 1
+#define EVENT_CHILD 2
+
+/**
+ * Create the epoll set, with a signalfd for SIGCHLD, which also sees
+ * children stop, and a pidfd per child when the kernel has them.
+ * SIGCHLD must already be blocked.
+ */
+void initEvents();
+
+/**
+ * Watch a child for its exit
+ * @param pid pid of child
+ * @return pidfd that was added to the set, -1 if children are seen through the signalfd
+ */
+int watchProcess(pid_t pid);
+
+/**
+ * Watch a descriptor the shell reads its input from
+ * @param fd descriptor
+ * @return true if the descriptor can be waited on, false otherwise (e.g. regular file)
+ */
+bool watchInput(int fd);
+
+/**
+ * Block until input is ready or a child changed state
+ * @return mask of EVENT_INPUT and EVENT_CHILD
+ */
+int waitEvents();
+
+/**
+ * Block until a child changed state, without waking up for input
+ * @return true once a child changed state, false if a signal interrupted the wait
+ */
+bool waitChildren();
\ No newline at end of file
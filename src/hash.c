@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "hash.h"
+
+/* Open addressed table of remembered commands, with linear probing */
+static hashEntry *hashTable = NULL;
+static size_t hashSize = 0;
+static size_t hashCount = 0;
+
+/* Value of PATH the remembered locations were found with */
+static char *hashPath = NULL;
+
+/**
+ * @brief FNV-1a hash of a command name
+ * 
+ * @param name Command name
+ * @return Hash value
+ */
+static size_t hashName(const char *name) {
+	size_t hash = 2166136261u;
+	while(*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * @brief Find the slot holding name, or the free slot it would go into
+ * 
+ * @param name Command name
+ * @return Index of slot
+ */
+static size_t findSlot(const char *name) {
+	size_t i = hashName(name) & (hashSize - 1);
+	while(hashTable[i].name && strcmp(hashTable[i].name, name) != 0)
+		i = (i + 1) & (hashSize - 1);
+	return i;
+}
+
+/**
+ * @brief Frees a slot, moving back later entries of its probe run so that
+ * no lookup stops early at the hole
+ * 
+ * @param i Index of slot
+ */
+static void removeSlot(size_t i) {
+	size_t j = i, home;
+
+	free(hashTable[i].name);
+	free(hashTable[i].path);
+	hashTable[i].name = NULL;
+	hashCount--;
+
+	while(1) {
+		j = (j + 1) & (hashSize - 1);
+		if(hashTable[j].name == NULL)
+			return;
+
+		/* Entry at j may fill the hole if its home is not in (i, j] */
+		home = hashName(hashTable[j].name) & (hashSize - 1);
+		if((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			hashTable[i] = hashTable[j];
+			hashTable[j].name = NULL;
+			i = j;
+		}
+	}
+}
+
+/**
+ * @brief Doubles the hash table, or creates it
+ * 
+ */
+static void growHashTable() {
+	hashEntry *old = hashTable;
+	size_t oldSize = hashSize;
+
+	hashSize = hashSize ? 2 * hashSize : HASH_INIT_SIZE;
+	hashTable = calloc(hashSize, sizeof(hashEntry));
+	if(hashTable == NULL) {
+		perror("hash");
+		exit(EXIT_FAILURE);
+	}
+
+	for(size_t i = 0; i < oldSize; i++)
+		if(old[i].name)
+			hashTable[findSlot(old[i].name)] = old[i];
+	free(old);
+}
+
+/**
+ * @brief Checks that path names an executable regular file
+ * 
+ * @param path Path to check
+ * @return 1 if it can be executed, 0 otherwise
+ */
+static int isExecutable(const char *path) {
+	struct stat sb;
+	return stat(path, &sb) == 0 && S_ISREG(sb.st_mode) && access(path, X_OK) == 0;
+}
+
+/**
+ * @brief Searches the directories of PATH for a command
+ * 
+ * An empty directory in PATH stands for the current directory, which is
+ * made absolute so that the path found has a slash and is executed as
+ * it is, rather than searched for again.
+ * 
+ * @param name Command name
+ * @param path Buffer of PATH_MAX bytes for the result
+ * @return 1 if found, 0 otherwise
+ */
+static int searchPath(const char *name, char *path) {
+	const char *dir = getenv("PATH"), *end;
+	size_t dirLen, nameLen = strlen(name);
+
+	if(dir == NULL)
+		return 0;
+
+	for(; ; dir = end + 1) {
+		end = strchrnul(dir, ':');
+		dirLen = end - dir;
+
+		if(dirLen == 0) {
+			if(getcwd(path, PATH_MAX) != NULL && (dirLen = strlen(path)) + nameLen + 2 <= PATH_MAX) {
+				path[dirLen] = '/';
+				memcpy(path + dirLen + 1, name, nameLen + 1);
+				if(isExecutable(path))
+					return 1;
+			}
+		}
+		else if(dirLen + nameLen + 2 <= PATH_MAX) {
+			memcpy(path, dir, dirLen);
+			path[dirLen] = '/';
+			memcpy(path + dirLen + 1, name, nameLen + 1);
+			if(isExecutable(path))
+				return 1;
+		}
+
+		if(*end == '\0')
+			return 0;
+	}
+}
+
+/**
+ * @brief Finds the file to execute for a command name
+ * 
+ * Remembered locations are dropped all at once when PATH has changed
+ * since they were found, and one at a time when the file they point to
+ * is gone. Names with a slash are never looked up.
+ * 
+ * @param name Command name as typed
+ * @return Path to execute, name itself if it has a slash or was not found
+ */
+char *hashLookup(char *name) {
+	char path[PATH_MAX];
+	char *envPath = getenv("PATH");
+	size_t i;
+
+	if(strchr(name, '/'))
+		return name;
+
+	if(envPath == NULL)
+		envPath = "";
+	if(hashPath == NULL || strcmp(hashPath, envPath) != 0) {
+		clearHashTable();
+		hashPath = strdup(envPath);
+	}
+
+	if(hashSize == 0)
+		growHashTable();
+
+	/* A remembered file was a regular one, so access is enough to see it is still there */
+	i = findSlot(name);
+	if(hashTable[i].name) {
+		if(access(hashTable[i].path, X_OK) == 0) {
+			hashTable[i].hits++;
+			return hashTable[i].path;
+		}
+		removeSlot(i);
+	}
+
+	if(!searchPath(name, path))
+		return name;
+
+	/* Keep load factor under a half */
+	if(2 * (hashCount + 1) > hashSize)
+		growHashTable();
+
+	i = findSlot(name);
+	hashTable[i].name = strdup(name);
+	hashTable[i].path = strdup(path);
+	hashTable[i].hits = 1;
+	hashCount++;
+	return hashTable[i].path;
+}
+
+/**
+ * @brief Forgets every remembered command location
+ * 
+ */
+void clearHashTable() {
+	for(size_t i = 0; i < hashSize; i++) {
+		if(hashTable[i].name) {
+			free(hashTable[i].name);
+			free(hashTable[i].path);
+			hashTable[i].name = NULL;
+		}
+	}
+	hashCount = 0;
+	free(hashPath);
+	hashPath = NULL;
+}
+
+/**
+ * @brief Prints remembered command locations with their hit counts
+ * 
+ */
+void printHashTable() {
+	if(hashCount == 0) {
+		printf("hash: hash table empty\n");
+		return;
+	}
+
+	printf("hits\tcommand\n");
+	for(size_t i = 0; i < hashSize; i++)
+		if(hashTable[i].name)
+			printf("%4u\t%s\n", hashTable[i].hits, hashTable[i].path);
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+/* Number of slots the command hash table starts with, a power of two */
+#define HASH_INIT_SIZE 64
+
+/**
+ * Remembered location of a command found by searching PATH
+ */
+typedef struct {
+	/* Name of the command as typed, NULL if the slot is free */
+	char *name;
+	/* Absolute path it resolved to */
+	char *path;
+	/* Number of times the remembered path was used */
+	unsigned int hits;
+} hashEntry;
+
+/**
+ * Find the file to execute for a command name, searching PATH only if
+ * the name is not in the hash table yet
+ * @param name command name as typed
+ * @return path to execute, name itself if it has a slash or was not found
+ */
+char *hashLookup(char *name);
+
+/**
+ * Forget every remembered command location
+ */
+void clearHashTable();
+
+/**
+ * Print remembered command locations, like the hash builtin of bash
+ */
+void printHashTable();
\ No newline at end of file
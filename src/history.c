@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "history.h"
+
+/* History of the shell, only opened by interactive shells */
+static history hist = { .fd = -1 };
+
+/**
+ * @brief Open and map the history file, or keep the history in memory if
+ * it cannot be opened
+ * 
+ * Nothing is read here: entries are only split and indexed when the history
+ * is first searched, so a long history costs nothing at startup.
+ * 
+ */
+void initHistory() {
+	char *file = getenv("FSH_HISTFILE"), *home, path[PATH_MAX];
+
+	if(file == NULL && (home = getenv("HOME"))) {
+		snprintf(path, sizeof(path), "%s/%s", home, HISTORY_FILE);
+		file = path;
+	}
+
+	/* Every entry goes in with one write at the end of the file, so shells
+	   sharing the file need no lock */
+	if(file && file[0]) {
+		hist.fd = open(file, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+		if(hist.fd == -1)
+			perror(file);
+	}
+	if(hist.fd == -1)
+		hist.fd = memfd_create("fsh_history", MFD_CLOEXEC);
+}
+
+/**
+ * @brief Maps what the file holds now, which grows as this shell and others
+ * append to it
+ * 
+ */
+static void mapHistory() {
+	struct stat st;
+	char *map;
+
+	if(hist.fd == -1 || fstat(hist.fd, &st) == -1 || (size_t)st.st_size == hist.mapSize)
+		return;
+
+	/* Truncated by someone else, start over */
+	if((size_t)st.st_size < hist.scanned) {
+		munmap(hist.map, hist.mapSize);
+		hist.map = NULL;
+		hist.mapSize = hist.scanned = 0;
+		hist.numEntries = hist.numSorted = 0;
+		if(st.st_size == 0)
+			return;
+	}
+
+	if(hist.map)
+		map = mremap(hist.map, hist.mapSize, st.st_size, MREMAP_MAYMOVE);
+	else
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, hist.fd, 0);
+	if(map == MAP_FAILED) {
+		perror("history");
+		return;
+	}
+	hist.map = map;
+	hist.mapSize = st.st_size;
+}
+
+/**
+ * @brief Adds the entries appended since the last call to the index of
+ * where entries start
+ * 
+ */
+static void indexHistory() {
+	char *p, *end, *newline;
+
+	mapHistory();
+	p = hist.map + hist.scanned;
+	end = hist.map + hist.mapSize;
+
+	/* A line without its newline yet is left for the next call */
+	while(p < end && (newline = memchr(p, '\n', end - p))) {
+		if(newline > p) {
+			if(hist.numEntries == hist.maxEntries) {
+				hist.maxEntries = hist.maxEntries ? 2 * hist.maxEntries : 1024;
+				hist.entries = realloc(hist.entries, hist.maxEntries * sizeof(size_t));
+				if(hist.entries == NULL) {
+					perror("history");
+					exit(EXIT_FAILURE);
+				}
+			}
+			hist.entries[hist.numEntries++] = p - hist.map;
+		}
+		p = newline + 1;
+	}
+	hist.scanned = p - hist.map;
+}
+
+/**
+ * @brief Text of an entry, which ends at a newline
+ * 
+ * @param i Number of entry, from 0
+ * @param len Set to the length of the text
+ * @return Text, not NUL terminated
+ */
+static const char *entryText(size_t i, size_t *len) {
+	const char *text = hist.map + hist.entries[i];
+	*len = (const char *)rawmemchr(text, '\n') - text;
+	return text;
+}
+
+/**
+ * @brief Prints an entry with its number, counted from 1
+ * 
+ * @param i Number of entry, from 0
+ */
+static void printEntry(size_t i) {
+	size_t len;
+	const char *text = entryText(i, &len);
+	printf("%5zu  %.*s\n", i + 1, (int)len, text);
+}
+
+/**
+ * @brief Compares the text of an entry with a prefix
+ * 
+ * @param i Number of entry, from 0
+ * @param prefix Prefix
+ * @param len Length of prefix
+ * @return Less than, equal to or greater than 0 as the entry sorts before,
+ * starts with or sorts after the prefix
+ */
+static int comparePrefix(size_t i, const char *prefix, size_t len) {
+	size_t textLen;
+	const char *text = entryText(i, &textLen);
+	int cmp = memcmp(text, prefix, textLen < len ? textLen : len);
+
+	if(cmp == 0 && textLen < len)
+		return -1;
+	return cmp;
+}
+
+/**
+ * @brief Compares two entries by text, then by number, for qsort
+ * 
+ */
+static int compareEntries(const void *a, const void *b) {
+	size_t i = *(const size_t *)a, j = *(const size_t *)b, lenI, lenJ;
+	const char *textI = entryText(i, &lenI), *textJ = entryText(j, &lenJ);
+	int cmp = memcmp(textI, textJ, lenI < lenJ ? lenI : lenJ);
+
+	if(cmp == 0)
+		cmp = (lenI > lenJ) - (lenI < lenJ);
+	if(cmp == 0)
+		cmp = (i > j) - (i < j);
+	return cmp;
+}
+
+/**
+ * @brief Compares two entry numbers, for qsort
+ * 
+ */
+static int compareNumbers(const void *a, const void *b) {
+	size_t i = *(const size_t *)a, j = *(const size_t *)b;
+	return (i > j) - (i < j);
+}
+
+/**
+ * @brief Merges the entries past the sorted index into it once there are
+ * too many of them to search one by one
+ * 
+ */
+static void sortHistory() {
+	size_t numTail = hist.numEntries - hist.numSorted, *tail, *merged;
+	size_t i = 0, j = 0, k = 0;
+
+	if(numTail <= HISTORY_TAIL_MAX)
+		return;
+
+	tail = malloc(numTail * sizeof(size_t));
+	merged = malloc(hist.numEntries * sizeof(size_t));
+	if(tail == NULL || merged == NULL) {
+		perror("history");
+		exit(EXIT_FAILURE);
+	}
+	for(k = 0; k < numTail; k++)
+		tail[k] = hist.numSorted + k;
+	qsort(tail, numTail, sizeof(size_t), compareEntries);
+
+	k = 0;
+	while(i < hist.numSorted && j < numTail)
+		merged[k++] = compareEntries(&hist.sorted[i], &tail[j]) < 0 ? hist.sorted[i++] : tail[j++];
+	while(i < hist.numSorted)
+		merged[k++] = hist.sorted[i++];
+	while(j < numTail)
+		merged[k++] = tail[j++];
+
+	free(tail);
+	free(hist.sorted);
+	hist.sorted = merged;
+	hist.numSorted = hist.numEntries;
+}
+
+/**
+ * @brief Finds the run of the sorted index whose entries start with a prefix
+ * 
+ * @param prefix Prefix
+ * @param len Length of prefix
+ * @param first Set to the position of the first entry of the run
+ * @return Position past the last entry of the run
+ */
+static size_t prefixRange(const char *prefix, size_t len, size_t *first) {
+	size_t lo = 0, hi = hist.numSorted, mid;
+
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(comparePrefix(hist.sorted[mid], prefix, len) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*first = lo;
+	while(hi < hist.numSorted && comparePrefix(hist.sorted[hi], prefix, len) == 0)
+		hi++;
+	return hi;
+}
+
+/**
+ * @brief Finds the latest entry starting with a prefix
+ * 
+ * Entries past the sorted index are the latest ones, so they are searched
+ * first.
+ * 
+ * @param prefix Prefix
+ * @return Number of entry from 0, -1 if none starts with prefix
+ */
+static long findPrefix(const char *prefix) {
+	size_t len = strlen(prefix), first, last;
+	long latest = -1;
+
+	indexHistory();
+	sortHistory();
+
+	for(size_t i = hist.numEntries; i > hist.numSorted; i--)
+		if(comparePrefix(i - 1, prefix, len) == 0)
+			return i - 1;
+
+	last = prefixRange(prefix, len, &first);
+	for(size_t k = first; k < last; k++)
+		if((long)hist.sorted[k] > latest)
+			latest = hist.sorted[k];
+	return latest;
+}
+
+/**
+ * @brief Append a command line to the history, where other shells see it too
+ * 
+ * Line and newline go in with a single write, which O_APPEND puts at the
+ * end of the file whatever other shells wrote in the meantime.
+ * 
+ * @param line Command line without its newline
+ */
+void addHistory(const char *line) {
+	struct iovec iov[2] = {
+		{ .iov_base = (void *)line, .iov_len = strlen(line) },
+		{ .iov_base = "\n", .iov_len = 1 },
+	};
+
+	if(hist.fd != -1 && writev(hist.fd, iov, 2) == -1)
+		perror("history");
+}
+
+/**
+ * @brief Replace a leading !!, !n, !-n or !prefix by the entry it recalls
+ * 
+ * What follows the first word of the line is kept after the entry, so
+ * "!make -j8" runs the latest make line with -j8 added.
+ * 
+ * @param line Command line
+ * @return line itself if it recalls nothing, the expanded line valid until
+ * the next call, or NULL if no entry matches
+ */
+char *expandHistory(char *line) {
+	static char *expanded = NULL;
+	char *event, *rest, *end;
+	const char *text;
+	size_t len;
+	long i, n;
+
+	if(line[0] != '!' || line[1] == '\0' || strchr(" \t=(", line[1]))
+		return line;
+
+	rest = line + 1 + strcspn(line + 1, " \t");
+	event = strndup(line + 1, rest - line - 1);
+	indexHistory();
+
+	n = strtol(event, &end, 10);
+	if(strcmp(event, "!") == 0)
+		i = (long)hist.numEntries - 1;
+	else if(*end == '\0' && n > 0)
+		i = n <= (long)hist.numEntries ? n - 1 : -1;
+	else if(*end == '\0' && n < 0)
+		i = (long)hist.numEntries + n;
+	else
+		i = findPrefix(event);
+
+	if(i < 0) {
+		fprintf(stderr, "fsh: !%s: event not found\n", event);
+		free(event);
+		return NULL;
+	}
+	free(event);
+
+	text = entryText(i, &len);
+	free(expanded);
+	if((expanded = malloc(len + strlen(rest) + 1)) == NULL) {
+		perror("history");
+		exit(EXIT_FAILURE);
+	}
+	strcpy(mempcpy(expanded, text, len), rest);
+	return expanded;
+}
+
+/**
+ * @brief Print the last entries of the history with their numbers
+ * 
+ * @param count Number of entries, all of them if 0
+ */
+void printHistory(size_t count) {
+	size_t i = 0;
+
+	indexHistory();
+	if(count && count < hist.numEntries)
+		i = hist.numEntries - count;
+	for(; i < hist.numEntries; i++)
+		printEntry(i);
+}
+
+/**
+ * @brief Print the entries of the history starting with or containing a text
+ * 
+ * Prefixes are looked up in the sorted index. Other matches are found with
+ * memmem over the whole mapping, which is about as fast as memory can be
+ * read, and each one is then matched to its entry by a binary search over
+ * where entries start.
+ * 
+ * @param text Text searched for
+ * @param prefix true to match only at the start of entries
+ * @return Number of entries printed
+ */
+size_t searchHistory(const char *text, bool prefix) {
+	size_t len = strlen(text), found = 0, first, last, lo, hi, mid;
+	const char *p, *end, *hit;
+	size_t *matches;
+
+	indexHistory();
+
+	if(prefix) {
+		sortHistory();
+		last = prefixRange(text, len, &first);
+		if((matches = malloc((last - first + 1) * sizeof(size_t))) == NULL) {
+			perror("history");
+			return 0;
+		}
+		memcpy(matches, hist.sorted + first, (last - first) * sizeof(size_t));
+		qsort(matches, last - first, sizeof(size_t), compareNumbers);
+		for(size_t k = 0; k < last - first; k++)
+			printEntry(matches[k]);
+		free(matches);
+
+		found = last - first;
+		for(size_t i = hist.numSorted; i < hist.numEntries; i++) {
+			if(comparePrefix(i, text, len) == 0) {
+				printEntry(i);
+				found++;
+			}
+		}
+		return found;
+	}
+
+	p = hist.map;
+	end = hist.map + hist.scanned;
+	while(len && p < end && (hit = memmem(p, end - p, text, len))) {
+		/* Last entry starting at or before the match */
+		lo = 0;
+		hi = hist.numEntries;
+		while(hi - lo > 1) {
+			mid = lo + (hi - lo) / 2;
+			if(hist.entries[mid] <= (size_t)(hit - hist.map))
+				lo = mid;
+			else
+				hi = mid;
+		}
+		printEntry(lo);
+		found++;
+		p = (const char *)rawmemchr(hit, '\n') + 1;
+	}
+	return found;
+}
+
+/**
+ * @brief Unmap and close the history file
+ * 
+ */
+void freeHistory() {
+	if(hist.map)
+		munmap(hist.map, hist.mapSize);
+	if(hist.fd != -1)
+		close(hist.fd);
+	free(hist.entries);
+	free(hist.sorted);
+	hist = (history){ .fd = -1 };
+}
@@ -0,0 +1,66 @@
+/* History file in HOME, unless FSH_HISTFILE names another one */
+#define HISTORY_FILE ".fsh_history"
+
+/* Entries past the sorted index that are searched one by one before
+   they are merged into it */
+#define HISTORY_TAIL_MAX 1024
+
+/**
+ * History of command lines, an append-only file mapped into memory with an
+ * index of where every entry starts and an index of entries sorted by text
+ */
+typedef struct {
+	/* History file, opened for appending */
+	int fd;
+	/* Mapping of the file, NULL while it is empty */
+	char *map;
+	size_t mapSize;
+	/* Bytes of the mapping split into entries, up to the last newline */
+	size_t scanned;
+	/* Offset in the file of every entry, oldest first */
+	size_t *entries;
+	size_t numEntries;
+	size_t maxEntries;
+	/* Numbers of entries [0, numSorted) sorted by text, then by number */
+	size_t *sorted;
+	size_t numSorted;
+} history;
+
+/**
+ * Open and map the history file, or keep the history in memory if it
+ * cannot be opened
+ */
+void initHistory();
+
+/**
+ * Append a command line to the history, where other shells see it too
+ * @param line command line without its newline
+ */
+void addHistory(const char *line);
+
+/**
+ * Replace a leading !!, !n, !-n or !prefix by the entry it recalls
+ * @param line command line
+ * @return line itself if it recalls nothing, the expanded line valid until
+ * the next call, or NULL if no entry matches
+ */
+char *expandHistory(char *line);
+
+/**
+ * Print the last entries of the history with their numbers
+ * @param count number of entries, all of them if 0
+ */
+void printHistory(size_t count);
+
+/**
+ * Print the entries of the history starting with or containing a text
+ * @param text text searched for
+ * @param prefix true to match only at the start of entries
+ * @return number of entries printed
+ */
+size_t searchHistory(const char *text, bool prefix);
+
+/**
+ * Unmap and close the history file
+ */
+void freeHistory();
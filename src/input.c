@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "input.h"
+
+/**
+ * @brief Start reading lines from a descriptor
+ * 
+ * @param in Pointer to reader
+ * @param fd Descriptor to read from
+ */
+void openReader(inputReader *in, int fd) {
+	in->fd = fd;
+	in->size = INPUT_BUF_SIZE;
+	in->buf = malloc(in->size);
+	if(in->buf == NULL) {
+		perror("openReader");
+		exit(EXIT_FAILURE);
+	}
+	in->start = 0;
+	in->end = 0;
+	in->scan = 0;
+	in->eof = false;
+	in->wait = NULL;
+}
+
+/**
+ * @brief Start reading lines from a string
+ * 
+ * The whole string is copied into the buffer up front.
+ * 
+ * @param in Pointer to reader
+ * @param str String holding the input
+ */
+void openStringReader(inputReader *in, const char *str) {
+	in->fd = -1;
+	in->end = strlen(str);
+	in->size = in->end + 1;
+	in->buf = malloc(in->size);
+	if(in->buf == NULL) {
+		perror("openStringReader");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(in->buf, str, in->end);
+	in->start = 0;
+	in->scan = 0;
+	in->eof = true;
+	in->wait = NULL;
+}
+
+/**
+ * @brief Read next line
+ * 
+ * Lines are cut out of the buffer in place, refilling it with one large
+ * read(2) only once no complete line is left. A line longer than the
+ * buffer doubles it, and only input read since the last call is searched
+ * for a newline, so a line of any length is read in linear time.
+ * 
+ * @param in Pointer to reader
+ * @return Line without its newline, valid until the next call,
+ * NULL at end of input
+ */
+char *readLine(inputReader *in) {
+	char *line, *newline, *buf;
+	size_t size;
+	ssize_t n;
+
+	while(1) {
+		line = in->buf + in->start;
+		newline = memchr(in->buf + in->scan, '\n', in->end - in->scan);
+		if(newline) {
+			*newline = '\0';
+			in->start = in->scan = newline - in->buf + 1;
+			return line;
+		}
+		in->scan = in->end;
+
+		/* Last line may lack a newline, one byte is always kept for its NUL */
+		if(in->eof) {
+			if(in->start == in->end)
+				return NULL;
+			in->buf[in->end] = '\0';
+			in->start = in->end;
+			return line;
+		}
+
+		/* Move partial line to front and fill the rest of the buffer */
+		memmove(in->buf, line, in->end - in->start);
+		in->end -= in->start;
+		in->scan = in->end;
+		in->start = 0;
+
+		/* Grow the buffer for a long line, shrink it back after one */
+		size = in->size;
+		if(in->end == in->size - 1)
+			size = 2 * in->size;
+		else if(in->size > INPUT_BUF_SIZE && in->end < INPUT_BUF_SIZE / 2)
+			size = INPUT_BUF_SIZE;
+		if(size != in->size) {
+			if((buf = realloc(in->buf, size)) == NULL) {
+				perror("readLine");
+				exit(EXIT_FAILURE);
+			}
+			in->buf = buf;
+			in->size = size;
+		}
+
+		if(in->wait)
+			in->wait(in->fd);
+		n = read(in->fd, in->buf + in->end, in->size - 1 - in->end);
+		if(n == -1) {
+			if(errno == EINTR)
+				continue;
+			perror("read");
+			n = 0;
+		}
+		if(n == 0)
+			in->eof = true;
+		in->end += n;
+	}
+}
+
+/**
+ * @brief Free the buffer of a reader and close its descriptor
+ * 
+ * @param in Pointer to reader
+ */
+void closeReader(inputReader *in) {
+	if(in->fd > STDERR_FILENO)
+		close(in->fd);
+	free(in->buf);
+	in->buf = NULL;
+}
\ No newline at end of file
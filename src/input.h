@@ -0,0 +1,50 @@
+/* Size of the buffer input is read into */
+#define INPUT_BUF_SIZE 65536
+
+/**
+ * Buffered reader handing out the input of the shell one line at a time,
+ * from a descriptor or from a string given with -c
+ */
+typedef struct {
+	/* Descriptor read from, -1 for a string */
+	int fd;
+	/* Buffer holding input not handed out yet */
+	char *buf;
+	size_t size;
+	/* Unread input is buf[start] up to buf[end] */
+	size_t start;
+	size_t end;
+	/* Unread input before buf[scan] holds no newline */
+	size_t scan;
+	/* No more input can be read into the buffer */
+	bool eof;
+	/* Called before every read of the descriptor, NULL to just block in read */
+	void (*wait)(int fd);
+} inputReader;
+
+/**
+ * Start reading lines from a descriptor
+ * @param in pointer to reader
+ * @param fd descriptor to read from
+ */
+void openReader(inputReader *in, int fd);
+
+/**
+ * Start reading lines from a string
+ * @param in pointer to reader
+ * @param str string holding the input
+ */
+void openStringReader(inputReader *in, const char *str);
+
+/**
+ * Read next line
+ * @param in pointer to reader
+ * @return line without its newline, valid until the next call, NULL at end of input
+ */
+char *readLine(inputReader *in);
+
+/**
+ * Free the buffer of a reader and close its descriptor
+ * @param in pointer to reader
+ */
+void closeReader(inputReader *in);
\ No newline at end of file
@@ -0,0 +1,704 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "jobs.h"
+#include "events.h"
+#include "jobsched.h"
+#include "trace.h"
+#include "stats.h"
+
+/* Jobs by ID - 1, with room for jobsTableSize of them */
+job **jobsTable = NULL;
+int jobsTableIdx = 0;
+static int jobsTableSize = 0;
+
+/* No slot below this one is free */
+static int firstFree = 0;
+
+/* Jobs made so far */
+static unsigned long jobsMade = 0;
+
+/* Open addressed index from pid to process of a job, with linear probing */
+static pidEntry *pidIndex = NULL;
+static size_t pidIndexSize = 0;
+static size_t pidIndexCount = 0;
+
+/* Background jobs that completed and were not reported yet */
+static int numDone = 0;
+
+/**
+ * @brief Allocates memory or exits
+ * 
+ * @param ptr Pointer to reallocate, NULL for a new allocation
+ * @param size Number of bytes needed
+ * @return Pointer to memory
+ */
+static void *xrealloc(void *ptr, size_t size) {
+	ptr = realloc(ptr, size);
+	if(ptr == NULL) {
+		perror("jobs");
+		exit(EXIT_FAILURE);
+	}
+	return ptr;
+}
+
+/**
+ * @brief Home slot of a pid in the index
+ * 
+ * @param pid Process ID
+ * @return Index of slot
+ */
+static size_t pidHash(pid_t pid) {
+	return ((unsigned int)pid * 2654435761u) & (pidIndexSize - 1);
+}
+
+/**
+ * @brief Find the entry of pid, or the free entry it would go into
+ * 
+ * @param pid Process ID
+ * @return Index of entry
+ */
+static size_t findEntry(pid_t pid) {
+	size_t i = pidHash(pid);
+	while(pidIndex[i].pid && pidIndex[i].pid != pid)
+		i = (i + 1) & (pidIndexSize - 1);
+	return i;
+}
+
+/**
+ * @brief Doubles the pid index, or creates it
+ * 
+ */
+static void growPidIndex() {
+	pidEntry *old = pidIndex;
+	size_t oldSize = pidIndexSize;
+
+	pidIndexSize = pidIndexSize ? 2 * pidIndexSize : PID_INDEX_INIT_SIZE;
+	pidIndex = calloc(pidIndexSize, sizeof(pidEntry));
+	if(pidIndex == NULL) {
+		perror("jobs");
+		exit(EXIT_FAILURE);
+	}
+
+	for(size_t i = 0; i < oldSize; i++)
+		if(old[i].pid)
+			pidIndex[findEntry(old[i].pid)] = old[i];
+	free(old);
+}
+
+/**
+ * @brief Drops a pid from the index
+ * 
+ * Later entries of the probe run are moved back into the hole so that no
+ * lookup stops early at it.
+ * 
+ * @param pid Process ID
+ */
+static void removeEntry(pid_t pid) {
+	size_t i, j, home;
+
+	if(pidIndexSize == 0)
+		return;
+	i = j = findEntry(pid);
+	if(pidIndex[i].pid == 0)
+		return;
+	pidIndex[i].pid = 0;
+	pidIndexCount--;
+
+	while(1) {
+		j = (j + 1) & (pidIndexSize - 1);
+		if(pidIndex[j].pid == 0)
+			return;
+
+		/* Entry at j may fill the hole if its home is not in (i, j] */
+		home = pidHash(pidIndex[j].pid);
+		if((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+			pidIndex[i] = pidIndex[j];
+			pidIndex[j].pid = 0;
+			i = j;
+		}
+	}
+}
+
+/**
+ * @brief Makes a job out of a command table
+ * 
+ * The job gets the lowest free ID and is stored at that place in jobs
+ * table, which doubles when it is full. IDs, and the part of the table
+ * scanned, stay as high as the number of jobs at once.
+ * 
+ * @param cmdTab Pointer to command table, owned by the job from now on
+ * @return Pointer to job
+ */
+job *makeJob(cmdTable *cmdTab) {
+	job *temp = xrealloc(NULL, sizeof(job));
+
+	temp->cmdTab = cmdTab;
+	temp->pgid = 0;
+	temp->maxPids = cmdTab->numCmds;
+	temp->procs = xrealloc(NULL, temp->maxPids * sizeof(process));
+	temp->numPids = 0;
+	temp->numProcs = 0;
+	temp->lastSlot = -1;
+	temp->status = FG;
+	temp->runner = NULL;
+	timerclear(&temp->utime);
+	timerclear(&temp->stime);
+	temp->maxrss = 0;
+	temp->timed = false;
+
+	temp->seq = ++jobsMade;
+
+	while(firstFree < jobsTableIdx && jobsTable[firstFree])
+		firstFree++;
+	if(firstFree == jobsTableIdx) {
+		if(jobsTableIdx == jobsTableSize) {
+			jobsTableSize = jobsTableSize ? 2 * jobsTableSize : JOBS_INIT_SIZE;
+			jobsTable = xrealloc(jobsTable, jobsTableSize * sizeof(job *));
+		}
+		jobsTableIdx++;
+	}
+	temp->id = firstFree + 1;
+	jobsTable[firstFree++] = temp;
+	return temp;
+}
+
+/**
+ * @brief Adds a started process to a job and to the pid index
+ * 
+ * @param j Pointer to job
+ * @param pid Process ID
+ */
+void addProcess(job *j, pid_t pid) {
+	size_t i;
+
+	if(j->numPids == j->maxPids) {
+		j->maxPids *= 2;
+		j->procs = xrealloc(j->procs, j->maxPids * sizeof(process));
+	}
+	j->procs[j->numPids].pid = pid;
+	j->procs[j->numPids].status = 0;
+	j->procs[j->numPids].completed = false;
+	j->procs[j->numPids].pidfd = watchProcess(pid);
+
+	/* Keep load factor under a half */
+	if(2 * (pidIndexCount + 1) > pidIndexSize)
+		growPidIndex();
+	i = findEntry(pid);
+	if(pidIndex[i].pid == 0)
+		pidIndexCount++;
+	pidIndex[i].pid = pid;
+	pidIndex[i].owner = j;
+	pidIndex[i].slot = j->numPids;
+
+	j->numPids++;
+	j->numProcs++;
+}
+
+/**
+ * @brief Finds the job a process belongs to using the pid index
+ * 
+ * @param pid Process ID
+ * @param slot Set to index of the process in its job
+ * @return Pointer to job, NULL if pid is not a running process of any job
+ */
+job *findJob(pid_t pid, int *slot) {
+	if(pidIndexSize == 0)
+		return NULL;
+
+	size_t i = findEntry(pid);
+	if(pidIndex[i].pid == 0)
+		return NULL;
+	*slot = pidIndex[i].slot;
+	return pidIndex[i].owner;
+}
+
+/**
+ * @brief Records a status reported by wait4 for a process of a job
+ * 
+ * A stopped process stops the job, a completed one is dropped from the
+ * pid index so that its pid can be reused and from the event loop, and
+ * its resource usage is added to the job.
+ * 
+ * @param j Pointer to job
+ * @param slot Index of process in the job
+ * @param status Status from wait4
+ * @param usage Resource usage from wait4
+ */
+void updateProcess(job *j, int slot, int status, struct rusage *usage) {
+	if(WIFSTOPPED(status)) {
+		j->status = STOPPED;
+		traceReap(j->procs[slot].pid, status);
+		statCounters[COUNT_STOPPED]++;
+	}
+	else if(WIFEXITED(status) || WIFSIGNALED(status)) {
+		if(j->procs[slot].completed)
+			return;
+		traceReap(j->procs[slot].pid, status);
+		statCounters[COUNT_REAPED]++;
+		if(childrenSeen)
+			recordLatency(STAT_REAP, childrenSeen);
+		j->procs[slot].completed = true;
+		j->procs[slot].status = status;
+		j->numProcs--;
+		timeradd(&j->utime, &usage->ru_utime, &j->utime);
+		timeradd(&j->stime, &usage->ru_stime, &j->stime);
+		if(usage->ru_maxrss > j->maxrss)
+			j->maxrss = usage->ru_maxrss;
+		removeEntry(j->procs[slot].pid);
+		if(j->procs[slot].pidfd != -1) {
+			close(j->procs[slot].pidfd);
+			j->procs[slot].pidfd = -1;
+		}
+		if(j->numProcs == 0 && j->timed)
+			clock_gettime(CLOCK_MONOTONIC, &j->finished);
+		if(j->numProcs == 0 && j->status == BG && j->runner == NULL)
+			numDone++;
+	}
+}
+
+/**
+ * @brief Reaps every child that has exited or stopped
+ * 
+ * Called whenever the event loop sees a pidfd or SIGCHLD fire. Keeps
+ * calling wait4 until nothing is left, so no exit is missed however
+ * many children changed state at once.
+ * 
+ */
+void reapChildren() {
+	struct rusage usage;
+	int status, slot;
+	pid_t pid;
+	job *j;
+
+	while(pidIndexCount > 0 && (pid = wait4(-1, &status, WNOHANG | WUNTRACED, &usage)) > 0) {
+		if((j = findJob(pid, &slot)))
+			updateProcess(j, slot, status, &usage);
+	}
+	childrenSeen = 0;
+}
+
+/**
+ * @brief Waits until a job has completed or stopped
+ * 
+ * Waits for any child rather than for the job's own processes, so that
+ * background children exiting meanwhile are reaped right away too.
+ * 
+ * @param j Pointer to job
+ * @return Last status from wait4 for a process of the job
+ */
+int waitForJob(job *j) {
+	struct rusage usage;
+	int status, slot, last = 0;
+	pid_t pid;
+	job *owner;
+
+	while(j->numProcs > 0 && j->status != STOPPED) {
+		if((pid = wait4(-1, &status, WUNTRACED, &usage)) == -1) {
+			if(errno == EINTR)
+				continue;
+			if(errno != ECHILD)
+				perror("wait4");
+			break;
+		}
+		childrenSeen = statsNow();
+		if((owner = findJob(pid, &slot))) {
+			updateProcess(owner, slot, status, &usage);
+			if(owner == j)
+				last = status;
+		}
+	}
+	childrenSeen = 0;
+	return last;
+}
+
+/**
+ * @brief Waits until one of a set of jobs has completed or stopped
+ * 
+ * Like waitForJob, children of other jobs are reaped as they exit.
+ * 
+ * @param jobs Array of pointers to jobs
+ * @param numJobs Number of jobs in array
+ * @return Pointer to the job, NULL if there are no children left to wait for
+ */
+job *waitForAnyJob(job **jobs, int numJobs) {
+	struct rusage usage;
+	int status, slot;
+	pid_t pid;
+	job *owner;
+
+	while(1) {
+		for(int i = 0; i < numJobs; i++) {
+			if(jobs[i]->numProcs == 0 || jobs[i]->status == STOPPED) {
+				childrenSeen = 0;
+				return jobs[i];
+			}
+		}
+
+		if((pid = wait4(-1, &status, WUNTRACED, &usage)) == -1) {
+			if(errno == EINTR)
+				continue;
+			if(errno != ECHILD)
+				perror("wait4");
+			childrenSeen = 0;
+			return NULL;
+		}
+		childrenSeen = statsNow();
+		if((owner = findJob(pid, &slot)))
+			updateProcess(owner, slot, status, &usage);
+	}
+}
+
+/**
+ * @brief Exit status of a job
+ * 
+ * @param j Pointer to job
+ * @return Exit code of its last process, 128 plus the signal number if it
+ * was killed, 127 if it could not be started, 0 while it is running
+ */
+int jobStatus(job *j) {
+	int status;
+
+	if(j->lastSlot == -1)
+		return 127;
+	if(!j->procs[j->lastSlot].completed)
+		return 0;
+	status = j->procs[j->lastSlot].status;
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/**
+ * @brief Formats a duration the way the time prefix prints it
+ * 
+ * @param buf Buffer of at least 32 bytes
+ * @param secs Duration in seconds
+ * @return buf
+ */
+static char *formatDuration(char *buf, double secs) {
+	int mins = secs / 60;
+	snprintf(buf, 32, "%dm%.3fs", mins, secs - 60.0 * mins);
+	return buf;
+}
+
+/**
+ * @brief Prints times and memory of a command, like time(1)
+ * 
+ * Written to standard error, so that it does not mix with the output of
+ * the command when that is redirected.
+ * 
+ * @param started When the command was started, from CLOCK_MONOTONIC
+ * @param finished When it finished, NULL for now
+ * @param utime User CPU time
+ * @param stime System CPU time
+ * @param maxrss Max RSS in KB
+ */
+void printTimes(struct timespec *started, struct timespec *finished, struct timeval *utime, struct timeval *stime, long maxrss) {
+	char real[32], user[32], sys[32];
+	struct timespec now;
+
+	if(finished == NULL) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		finished = &now;
+	}
+	fflush(stdout);
+	fprintf(stderr, "real\t%s\nuser\t%s\nsys\t%s\nmaxrss\t%ld KB\n",
+		formatDuration(real, (finished->tv_sec - started->tv_sec) + (finished->tv_nsec - started->tv_nsec) / 1e9),
+		formatDuration(user, utime->tv_sec + utime->tv_usec / 1e6),
+		formatDuration(sys, stime->tv_sec + stime->tv_usec / 1e6),
+		maxrss);
+}
+
+/**
+ * @brief Prints times and memory of a job run with the time prefix
+ * 
+ * CPU time is the sum over all its processes, memory the largest max RSS
+ * of any of them.
+ * 
+ * @param j Pointer to job
+ */
+void printJobTimes(job *j) {
+	printTimes(&j->started, &j->finished, &j->utime, &j->stime, j->maxrss);
+}
+
+/**
+ * @brief Reports completed background jobs
+ * 
+ * Runs from the main loop, never from a signal handler.
+ * 
+ * @return Number of jobs reported
+ */
+int notifyJobs() {
+	int reported = 0;
+
+	if(numDone == 0)
+		return 0;
+
+	for(int i = 0; i < jobsTableIdx; i++) {
+		job *j = jobsTable[i];
+		if(j && j->numProcs == 0 && j->status == BG && j->runner == NULL) {
+			printf("[%d]\tDone\t\tPGID [%d]\t\t\"%s\"\n", j->id, j->pgid, j->cmdTab->cmdLine);
+			if(j->timed)
+				printJobTimes(j);
+			removeJob(j);
+			reported++;
+		}
+	}
+	numDone = 0;
+	return reported;
+}
+
+/**
+ * @brief Gets a job by its ID
+ * 
+ * @param id Job ID
+ * @return Pointer to job, NULL if there is no such job
+ */
+job *getJob(int id) {
+	if(id < 1 || id > jobsTableIdx)
+		return NULL;
+	return jobsTable[id - 1];
+}
+
+/**
+ * @brief Gets the most recently started job
+ * 
+ * @return Pointer to job, NULL if there are no jobs
+ */
+job *lastJob() {
+	job *last = NULL;
+
+	for(int i = 0; i < jobsTableIdx; i++)
+		if(jobsTable[i] && (last == NULL || jobsTable[i]->seq > last->seq))
+			last = jobsTable[i];
+	return last;
+}
+
+/**
+ * @brief Removes a job from the jobs table
+ * 
+ * Frees the job and releases its command table. Other jobs keep their
+ * place, and its ID goes to the next job made.
+ * 
+ * @param j Pointer to job
+ */
+void removeJob(job *j) {
+	for(int i = 0; i < j->numPids; i++) {
+		if(!j->procs[i].completed)
+			removeEntry(j->procs[i].pid);
+		if(j->procs[i].pidfd != -1)
+			close(j->procs[i].pidfd);
+	}
+
+	jobsTable[j->id - 1] = NULL;
+	if(j->id - 1 < firstFree)
+		firstFree = j->id - 1;
+	while(jobsTableIdx > 0 && jobsTable[jobsTableIdx - 1] == NULL)
+		jobsTableIdx--;
+	if(firstFree > jobsTableIdx)
+		firstFree = jobsTableIdx;
+
+	releaseCmdTable(j->cmdTab);
+	free(j->procs);
+	free(j);
+}
+
+/**
+ * @brief Adds the usage of a process that was not reaped yet
+ * 
+ * Read from /proc, as wait4 only reports usage once a process is gone.
+ * 
+ * @param pid Process ID
+ * @param cpu CPU time in seconds, added to
+ * @param maxrss Max RSS in KB, raised to that of the process
+ */
+static void liveUsage(pid_t pid, double *cpu, long *maxrss) {
+	char path[64], line[512], *p;
+	unsigned long utime, stime;
+	long hwm;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if((fp = fopen(path, "re"))) {
+		/* Command name may contain anything, fields are counted after it */
+		if(fgets(line, sizeof(line), fp) && (p = strrchr(line, ')')) &&
+		   sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) == 2)
+			*cpu += (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+		fclose(fp);
+	}
+
+	snprintf(path, sizeof(path), "/proc/%d/status", pid);
+	if((fp = fopen(path, "re"))) {
+		while(fgets(line, sizeof(line), fp)) {
+			if(sscanf(line, "VmHWM: %ld", &hwm) == 1) {
+				if(hwm > *maxrss)
+					*maxrss = hwm;
+				break;
+			}
+		}
+		fclose(fp);
+	}
+}
+
+/**
+ * @brief Apply CPU, nice and I/O priority settings to a running job
+ * 
+ * Affinity and priorities belong to threads, so every thread listed in
+ * /proc is changed, not only the main one. Children the job started
+ * itself keep what they inherited. Process i gets the CPUs of stage i.
+ * 
+ * @param j Pointer to job
+ * @param spec Pointer to settings
+ * @return 0 on success, -1 if a setting could not be applied
+ */
+int setJobSched(job *j, const struct schedSpec *spec) {
+	char path[64];
+	struct dirent *entry;
+	int status = 0;
+	DIR *dir;
+
+	for(int i = 0; i < j->numPids; i++) {
+		if(j->procs[i].completed)
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%d/task", j->procs[i].pid);
+		if((dir = opendir(path)) == NULL) {
+			if(applySched(j->procs[i].pid, spec, i) == -1 && errno != ESRCH)
+				status = -1;
+			continue;
+		}
+		while((entry = readdir(dir))) {
+			if(entry->d_name[0] != '.' && applySched(atoi(entry->d_name), spec, i) == -1 && errno != ESRCH)
+				status = -1;
+		}
+		closedir(dir);
+	}
+	return status;
+}
+
+/**
+ * @brief Describes the settings of a job that differ from the shell's
+ * 
+ * Read from the kernel, so changes made by renice, pin or anything else
+ * show too. CPUs are given for every process, separated by / like in
+ * the sched prefix, when they are not all the same; nice value and I/O
+ * priority are those of the first running process.
+ * 
+ * @param j Pointer to job
+ * @param buf Buffer for the description
+ * @param size Size of buffer
+ * @return buf, NULL if the job runs with the settings of the shell
+ */
+static char *describeJobSched(job *j, char *buf, size_t size) {
+	cpuMask shellMask, mask, firstMask;
+	int shellNice, shellIoprio, nice, ioprio, firstNice = 0, firstIoprio = 0;
+	int len = 0, cpusLen = 0, numLive = 0;
+	bool pinned = false, same = true;
+	char cpus[512];
+
+	if(getSched(0, shellMask, &shellNice, &shellIoprio) == -1)
+		return NULL;
+
+	for(int i = 0; i < j->numPids; i++) {
+		if(j->procs[i].completed || getSched(j->procs[i].pid, mask, &nice, &ioprio) == -1)
+			continue;
+		if(numLive++ == 0) {
+			memcpy(firstMask, mask, sizeof(cpuMask));
+			firstNice = nice;
+			firstIoprio = ioprio;
+		}
+		else if(memcmp(mask, firstMask, sizeof(cpuMask)) != 0) {
+			same = false;
+		}
+		if(memcmp(mask, shellMask, sizeof(cpuMask)) != 0)
+			pinned = true;
+		if(cpusLen > 0 && (size_t)cpusLen < sizeof(cpus) - 1)
+			cpus[cpusLen++] = '/';
+		if((size_t)cpusLen < sizeof(cpus))
+			cpusLen += formatCpus(mask, cpus + cpusLen, sizeof(cpus) - cpusLen);
+	}
+	if(numLive == 0)
+		return NULL;
+
+	if(pinned) {
+		if(same)
+			formatCpus(firstMask, cpus, sizeof(cpus));
+		len += snprintf(buf + len, size - len, "cpus %s", cpus);
+	}
+	if(firstNice != shellNice && (size_t)len < size)
+		len += snprintf(buf + len, size - len, "%snice %d", len ? ", " : "", firstNice);
+	if(firstIoprio != shellIoprio && (size_t)len + 4 < size) {
+		len += snprintf(buf + len, size - len, "%sio ", len ? ", " : "");
+		len += formatIoprio(firstIoprio, buf + len, size - len);
+	}
+	return len ? buf : NULL;
+}
+
+/**
+ * @brief Prints jobs table
+ * 
+ * With usage, CPU time and max RSS are shown for every job, from wait4
+ * for its reaped processes and from /proc for the others. CPUs and
+ * priorities a job runs with follow its command when they are not the
+ * shell's own.
+ * 
+ * @param usage Whether to show resource usage
+ */
+void printJobsTable(bool usage) {
+	static const char *states[] = { "Foreground", "Running", "Stopped" };
+	char settings[640], *sched;
+	double cpu;
+	long maxrss;
+
+	if(jobsTableIdx == 0) {
+		printf("No background or stopped jobs\n");
+		return;
+	}
+
+	if(usage)
+		printf(" ID\t PGID \t  Status \t    CPU\t    MaxRSS\tCommand\n");
+	else
+		printf(" ID\t PGID \t  Status \tCommand\n");
+
+	for(int i = 0; i < jobsTableIdx; i++) {
+		job *j = jobsTable[i];
+		if(j == NULL)
+			continue;
+		sched = describeJobSched(j, settings, sizeof(settings));
+
+		if(!usage) {
+			printf("[%d]\t%d\t  %s\t%s%s%s%s\n", j->id, j->pgid, states[j->status], j->cmdTab->cmdLine,
+				sched ? "\t(" : "", sched ? sched : "", sched ? ")" : "");
+			continue;
+		}
+
+		cpu = j->utime.tv_sec + j->utime.tv_usec / 1e6 + j->stime.tv_sec + j->stime.tv_usec / 1e6;
+		maxrss = j->maxrss;
+		for(int k = 0; k < j->numPids; k++)
+			if(!j->procs[k].completed)
+				liveUsage(j->procs[k].pid, &cpu, &maxrss);
+		printf("[%d]\t%d\t  %s\t%7.2fs\t%7ld KB\t%s%s%s%s\n", j->id, j->pgid, states[j->status], cpu, maxrss, j->cmdTab->cmdLine,
+			sched ? "\t(" : "", sched ? sched : "", sched ? ")" : "");
+	}
+}
+
+/**
+ * @brief Frees the global job table
+ * 
+ */
+void freeJobsTable() {
+	while(jobsTableIdx > 0) {
+		removeJob(jobsTable[jobsTableIdx - 1]);
+	}
+	free(jobsTable);
+	free(pidIndex);
+	jobsTable = NULL;
+	pidIndex = NULL;
+	jobsTableSize = 0;
+	firstFree = 0;
+	pidIndexSize = pidIndexCount = 0;
+}
\ No newline at end of file
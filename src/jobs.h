@@ -0,0 +1,191 @@
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "parse.h"
+
+/* Job slots allocated at first, doubled when they run out */
+#define JOBS_INIT_SIZE 16
+
+/* Slots of pid index allocated at first, a power of two */
+#define PID_INDEX_INIT_SIZE 64
+
+/* States a process or a job can be in */
+typedef enum {
+	FG, BG, STOPPED
+} ProcState;
+
+/* Structure to store information for a process of a job */
+typedef struct {
+	pid_t pid;
+	/* Status reported by waitpid once it has completed */
+	int status;
+	bool completed;
+	/* pidfd watched by the event loop until it is reaped, -1 if none */
+	int pidfd;
+} process;
+
+/* Structure to store information for a process group or a job */
+typedef struct {
+	/* To store all information regarding processes in that group, owned by the job */
+	cmdTable *cmdTab;
+	/* Job ID, which is its index in jobs table plus one and never changes */
+	int id;
+	/* Order the job was made in, as IDs of completed jobs are given again */
+	unsigned long seq;
+	/* Process Group ID of the job */
+	pid_t pgid;
+	/* Processes of the job in the order they were started */
+	process *procs;
+	int numPids;
+	int maxPids;
+	/* Number of processes running or stopped i.e. not completed */
+	int numProcs;
+	/* Slot of the process running the last command, -1 if it could not be started */
+	int lastSlot;
+	/* Status of job */
+	ProcState status;
+	/* Parallel run that reports the job once it completes, NULL if the shell does */
+	void *runner;
+	/* CPU time of its reaped processes and the largest max RSS among them in KB */
+	struct timeval utime;
+	struct timeval stime;
+	long maxrss;
+	/* Whether it was run with the time prefix, since when and until when */
+	bool timed;
+	struct timespec started;
+	struct timespec finished;
+} job;
+
+/* Entry of the index from a pid to its job and slot in that job */
+typedef struct {
+	/* 0 if the entry is free */
+	pid_t pid;
+	job *owner;
+	int slot;
+} pidEntry;
+
+/* Jobs by ID, NULL where an ID is free, and one past the highest ID in use */
+extern job **jobsTable;
+extern int jobsTableIdx;
+
+/**
+ * Create a job for a command table and give it the next job ID
+ * @param cmdTab pointer to command table, owned by the job from now on
+ * @return pointer to new job
+ */
+job *makeJob(cmdTable *cmdTab);
+
+/**
+ * Add a started process to a job
+ * @param j pointer to job
+ * @param pid pid of process
+ */
+void addProcess(job *j, pid_t pid);
+
+/**
+ * Find the job a process belongs to
+ * @param pid pid of process
+ * @param slot set to index of process in the job
+ * @return pointer to job, NULL if pid is not a running process of any job
+ */
+job *findJob(pid_t pid, int *slot);
+
+/**
+ * Record a status reported by wait4 for a process of a job
+ * @param j pointer to job
+ * @param slot index of process in the job
+ * @param status status from wait4
+ * @param usage resource usage from wait4
+ */
+void updateProcess(job *j, int slot, int status, struct rusage *usage);
+
+/**
+ * Reap every child that has exited or stopped, without blocking
+ */
+void reapChildren();
+
+/**
+ * Block until a job has completed or stopped, reaping other children too
+ * @param j pointer to job
+ * @return last status from wait4 for a process of the job
+ */
+int waitForJob(job *j);
+
+/**
+ * Block until one of a set of jobs has completed or stopped, reaping other
+ * children too
+ * @param jobs array of pointers to jobs
+ * @param numJobs number of jobs in array
+ * @return pointer to the job, NULL if there are no children left to wait for
+ */
+job *waitForAnyJob(job **jobs, int numJobs);
+
+/**
+ * Exit status of a job, which is the one of its last command
+ * @param j pointer to job
+ * @return exit code of last process, 128 plus the signal number if it was
+ * killed, 127 if it could not be started
+ */
+int jobStatus(job *j);
+
+/**
+ * Print times and memory like the time prefix does
+ * @param started when the command was started, from CLOCK_MONOTONIC
+ * @param finished when it finished, NULL for now
+ * @param utime user CPU time
+ * @param stime system CPU time
+ * @param maxrss max RSS in KB
+ */
+void printTimes(struct timespec *started, struct timespec *finished, struct timeval *utime, struct timeval *stime, long maxrss);
+
+/**
+ * Print times and memory of a job run with the time prefix
+ * @param j pointer to job
+ */
+void printJobTimes(job *j);
+
+/**
+ * Print a message for every completed background job and remove it
+ * @return number of jobs reported
+ */
+int notifyJobs();
+
+/**
+ * Get a job by its ID
+ * @param id job ID
+ * @return pointer to job, NULL if there is no such job
+ */
+job *getJob(int id);
+
+/**
+ * Get the most recently started job still in jobs table
+ * @return pointer to job, NULL if there are no jobs
+ */
+job *lastJob();
+
+/**
+ * Removes a job from jobs table and frees it, releasing its command table
+ * @param j pointer to job
+ */
+void removeJob(job *j);
+
+/**
+ * Apply CPU, nice and I/O priority settings to every thread of the
+ * running processes of a job
+ * @param j pointer to job
+ * @param spec pointer to settings
+ * @return 0 on success, -1 if a setting could not be applied
+ */
+int setJobSched(job *j, const struct schedSpec *spec);
+
+/**
+ * Function to print jobs table
+ * @param usage whether to show CPU time and max RSS of every job
+ */
+void printJobsTable(bool usage);
+
+/**
+ * Frees jobs table
+ */
+void freeJobsTable();
\ No newline at end of file
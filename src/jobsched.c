@@ -0,0 +1,312 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include "parse.h"
+#include "jobsched.h"
+
+/* I/O priority as in linux/ioprio.h, the class in the top bits */
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_LEVEL_MASK ((1 << IOPRIO_CLASS_SHIFT) - 1)
+#define IOPRIO_WHO_PROCESS 1
+
+/* Names of the I/O scheduling classes, by number */
+static const char *ioClasses[] = { "none", "rt", "be", "idle" };
+
+/* Bits in a word of a mask */
+#define MASK_BITS (8 * sizeof(unsigned long))
+
+/**
+ * @brief Adds a range of CPUs to a mask
+ * 
+ * @param mask Mask
+ * @param first First CPU
+ * @param last Last CPU
+ */
+static void addCpus(cpuMask mask, long first, long last) {
+	for(long c = first; c <= last; c++)
+		mask[c / MASK_BITS] |= 1UL << (c % MASK_BITS);
+}
+
+/**
+ * @brief Tells whether a mask has a CPU
+ * 
+ * @param mask Mask
+ * @param c CPU
+ * @return true if c is in mask
+ */
+static bool hasCpu(const unsigned long *mask, long c) {
+	return mask[c / MASK_BITS] & (1UL << (c % MASK_BITS));
+}
+
+/**
+ * @brief Parse CPU lists like "0-3,8" separated by / into the masks of
+ * a spec, one for every stage of a pipeline
+ * 
+ * @param lists CPU lists
+ * @param mem Arena to allocate the masks from
+ * @param spec Pointer to spec
+ * @return true on success, false if a list is invalid or empty
+ */
+bool parseCpus(const char *lists, arena *mem, schedSpec *spec) {
+	const char *c = lists;
+	long first, last;
+	char *end;
+	bool empty;
+
+	spec->numMasks = 1;
+	for(c = lists; *c; c++)
+		if(*c == '/')
+			spec->numMasks++;
+	spec->masks = arenaAlloc(mem, spec->numMasks * sizeof(cpuMask));
+	memset(spec->masks, 0, spec->numMasks * sizeof(cpuMask));
+
+	c = lists;
+	for(int i = 0; i < spec->numMasks; i++) {
+		empty = true;
+		while(*c && *c != '/') {
+			first = last = strtol(c, &end, 10);
+			if(end == c || first < 0)
+				return false;
+			if(*end == '-') {
+				c = end + 1;
+				last = strtol(c, &end, 10);
+				if(end == c)
+					return false;
+			}
+			if(last < first || last >= SCHED_MAX_CPUS || (*end && *end != ',' && *end != '/'))
+				return false;
+			addCpus(spec->masks[i], first, last);
+			empty = false;
+			c = *end == ',' ? end + 1 : end;
+		}
+		if(empty)
+			return false;
+		if(*c == '/')
+			c++;
+	}
+	spec->flags |= SCHED_CPUS;
+	return true;
+}
+
+/**
+ * @brief Parses an I/O priority like "idle", "be" or "rt:0"
+ * 
+ * @param arg Priority
+ * @param ioprio Set to class and level packed for ioprio_set
+ * @return true on success, false if it is invalid
+ */
+static bool parseIoprio(const char *arg, int *ioprio) {
+	size_t len = strcspn(arg, ":");
+	long level = 4;
+	char *end;
+	int class;
+
+	for(class = 1; class < 4; class++)
+		if(strlen(ioClasses[class]) == len && strncmp(arg, ioClasses[class], len) == 0)
+			break;
+	if(class == 4)
+		return false;
+
+	if(arg[len] == ':') {
+		level = strtol(arg + len + 1, &end, 10);
+		if(end == arg + len + 1 || *end || level < 0 || level > 7)
+			return false;
+	}
+	/* The idle class has no levels */
+	if(class == 3)
+		level = 0;
+	*ioprio = class << IOPRIO_CLASS_SHIFT | level;
+	return true;
+}
+
+/**
+ * @brief Parses the options of the sched prefix and of renice
+ * 
+ * -c takes CPU lists, one for each stage of the pipeline, -n a nice
+ * value from -20 to 19 which is set as it is rather than added to that
+ * of the shell, and -i an I/O scheduling class, rt, be or idle, with an
+ * optional level from 0 to 7.
+ * 
+ * @param argv NULL terminated argument vector, options first
+ * @param name Name to prefix messages with
+ * @param mem Arena to allocate the masks from
+ * @param spec Pointer to spec, cleared first
+ * @return Number of words taken by the options, -1 on an invalid one
+ */
+int parseSchedOptions(char **argv, const char *name, arena *mem, schedSpec *spec) {
+	char *end;
+	int i;
+
+	memset(spec, 0, sizeof(schedSpec));
+	for(i = 0; argv[i] && argv[i][0] == '-' && argv[i][1] && argv[i][2] == '\0'; i += 2) {
+		if(argv[i + 1] == NULL) {
+			fprintf(stderr, "%s: %s needs a value\n", name, argv[i]);
+			return -1;
+		}
+		switch(argv[i][1]) {
+			case 'c':
+				if(!parseCpus(argv[i + 1], mem, spec)) {
+					fprintf(stderr, "%s: %s: invalid CPU list\n", name, argv[i + 1]);
+					return -1;
+				}
+				break;
+			case 'n':
+				spec->nice = strtol(argv[i + 1], &end, 10);
+				if(end == argv[i + 1] || *end || spec->nice < -20 || spec->nice > 19) {
+					fprintf(stderr, "%s: %s: invalid nice value\n", name, argv[i + 1]);
+					return -1;
+				}
+				spec->flags |= SCHED_NICE;
+				break;
+			case 'i':
+				if(!parseIoprio(argv[i + 1], &spec->ioprio)) {
+					fprintf(stderr, "%s: %s: invalid I/O priority\n", name, argv[i + 1]);
+					return -1;
+				}
+				spec->flags |= SCHED_IOPRIO;
+				break;
+			default:
+				fprintf(stderr, "%s: %s: unknown option\n", name, argv[i]);
+				return -1;
+		}
+	}
+	return i;
+}
+
+/**
+ * @brief Takes the sched prefix and its options off the first command
+ * of a table
+ * 
+ * Like the time prefix, it is part of the syntax rather than a builtin,
+ * and applies to the whole pipeline after it. The spec is allocated in
+ * the arena of the table, so a cached line keeps it.
+ * 
+ * @param cmdTab Pointer to command table
+ * @return true on success, false if the options are invalid or no command
+ * follows them
+ */
+bool parseSched(cmdTable *cmdTab) {
+	schedSpec *spec = arenaAlloc(&cmdTab->mem, sizeof(schedSpec));
+	int taken = parseSchedOptions(cmdTab->args[0] + 1, "sched", &cmdTab->mem, spec);
+
+	if(taken == -1)
+		return false;
+	cmdTab->args[0] += taken + 1;
+	if(cmdTab->args[0][0] == NULL || spec->flags == 0) {
+		fprintf(stderr, SCHED_USAGE);
+		return false;
+	}
+	cmdTab->sched = spec;
+	return true;
+}
+
+/**
+ * @brief Copy a spec and its masks into an arena
+ * 
+ * @param mem Arena to allocate from
+ * @param spec Pointer to spec
+ * @return Pointer to the copy
+ */
+schedSpec *copySched(arena *mem, const schedSpec *spec) {
+	schedSpec *copy = arenaAlloc(mem, sizeof(schedSpec));
+
+	*copy = *spec;
+	if(spec->numMasks) {
+		copy->masks = arenaAlloc(mem, spec->numMasks * sizeof(cpuMask));
+		memcpy(copy->masks, spec->masks, spec->numMasks * sizeof(cpuMask));
+	}
+	return copy;
+}
+
+/**
+ * @brief Apply a spec to a thread, in a child before it executes or to
+ * a thread of a running job
+ * 
+ * @param tid Thread ID, 0 for the calling thread
+ * @param spec Pointer to spec
+ * @param stage Index of the command in its pipeline
+ * @return 0 on success, -1 on failure with errno set
+ */
+int applySched(pid_t tid, const schedSpec *spec, int stage) {
+	if(stage >= spec->numMasks)
+		stage = spec->numMasks - 1;
+	if((spec->flags & SCHED_CPUS) && sched_setaffinity(tid, sizeof(cpuMask), (cpu_set_t *)spec->masks[stage]) == -1)
+		return -1;
+	if((spec->flags & SCHED_NICE) && setpriority(PRIO_PROCESS, tid, spec->nice) == -1)
+		return -1;
+	if((spec->flags & SCHED_IOPRIO) && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, spec->ioprio) == -1)
+		return -1;
+	return 0;
+}
+
+/**
+ * @brief Get the settings of a thread
+ * 
+ * @param tid Thread ID, 0 for the calling thread
+ * @param mask Set to the CPUs it may run on
+ * @param nice Set to its nice value
+ * @param ioprio Set to its I/O priority
+ * @return 0 on success, -1 if it is gone
+ */
+int getSched(pid_t tid, cpuMask mask, int *nice, int *ioprio) {
+	memset(mask, 0, sizeof(cpuMask));
+	if(sched_getaffinity(tid, sizeof(cpuMask), (cpu_set_t *)mask) == -1)
+		return -1;
+	errno = 0;
+	*nice = getpriority(PRIO_PROCESS, tid);
+	if(errno)
+		return -1;
+	*ioprio = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid);
+	return 0;
+}
+
+/**
+ * @brief Format a mask as a CPU list like "0-3,8"
+ * 
+ * @param mask Mask
+ * @param buf Buffer
+ * @param size Size of buffer
+ * @return Number of characters written
+ */
+int formatCpus(const unsigned long *mask, char *buf, size_t size) {
+	int len = 0;
+	long first;
+
+	for(long c = 0; c < SCHED_MAX_CPUS; c++) {
+		if(!hasCpu(mask, c))
+			continue;
+		for(first = c; c + 1 < SCHED_MAX_CPUS && hasCpu(mask, c + 1); c++)
+			;
+		if((size_t)len < size) {
+			if(first == c)
+				len += snprintf(buf + len, size - len, "%s%ld", len ? "," : "", c);
+			else
+				len += snprintf(buf + len, size - len, "%s%ld-%ld", len ? "," : "", first, c);
+		}
+	}
+	return len;
+}
+
+/**
+ * @brief Format an I/O priority like "be:4" or "idle"
+ * 
+ * @param ioprio Class and level packed the way ioprio_set takes them
+ * @param buf Buffer
+ * @param size Size of buffer
+ * @return Number of characters written
+ */
+int formatIoprio(int ioprio, char *buf, size_t size) {
+	int class = (ioprio >> IOPRIO_CLASS_SHIFT) & 3;
+
+	/* The idle class has no levels */
+	if(class == 3)
+		return snprintf(buf, size, "%s", ioClasses[class]);
+	return snprintf(buf, size, "%s:%d", ioClasses[class], ioprio & IOPRIO_LEVEL_MASK);
+}
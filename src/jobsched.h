@@ -0,0 +1,103 @@
+/* Usage message of the sched prefix */
+#define SCHED_USAGE "usage: sched [-c cpus[/cpus...]] [-n nice] [-i class[:level]] command\n"
+
+/* Settings given for a job */
+#define SCHED_CPUS 1
+#define SCHED_NICE 2
+#define SCHED_IOPRIO 4
+
+/* CPUs a mask can name, as many as a cpu_set_t holds */
+#define SCHED_MAX_CPUS 1024
+#define SCHED_MASK_WORDS (SCHED_MAX_CPUS / (8 * sizeof(unsigned long)))
+
+/* Set of CPUs, laid out like a cpu_set_t */
+typedef unsigned long cpuMask[SCHED_MASK_WORDS];
+
+/**
+ * CPU affinity, nice value and I/O priority of the processes of a job,
+ * set in every child before it executes its program
+ */
+typedef struct schedSpec {
+	/* Which of the settings below are given */
+	int flags;
+	int nice;
+	/* Class and level packed the way ioprio_set takes them */
+	int ioprio;
+	/* CPUs of every stage of the pipeline in order, the last mask going
+	   to the stages after it too */
+	cpuMask *masks;
+	int numMasks;
+} schedSpec;
+
+/**
+ * Parse CPU lists like "0-3,8" separated by / into the masks of a spec
+ * @param lists CPU lists
+ * @param mem arena to allocate the masks from
+ * @param spec pointer to spec
+ * @return true on success, false if a list is invalid
+ */
+bool parseCpus(const char *lists, arena *mem, schedSpec *spec);
+
+/**
+ * Parse the options -c cpus, -n nice and -i class[:level] at the start of
+ * an argument vector, printing a message on an invalid one
+ * @param argv NULL terminated argument vector, options first
+ * @param name name to prefix messages with
+ * @param mem arena to allocate the masks from
+ * @param spec pointer to spec, cleared first
+ * @return number of words taken by the options, -1 on an invalid one
+ */
+int parseSchedOptions(char **argv, const char *name, arena *mem, schedSpec *spec);
+
+/**
+ * Take the sched prefix and its options off the first command of a table
+ * @param cmdTab pointer to command table
+ * @return true on success, false if the options are invalid or no command
+ * follows them
+ */
+bool parseSched(cmdTable *cmdTab);
+
+/**
+ * Copy a spec and its masks into an arena
+ * @param mem arena to allocate from
+ * @param spec pointer to spec
+ * @return pointer to the copy
+ */
+schedSpec *copySched(arena *mem, const schedSpec *spec);
+
+/**
+ * Apply a spec to a thread
+ * @param tid thread ID, 0 for the calling thread
+ * @param spec pointer to spec
+ * @param stage index of the command in its pipeline
+ * @return 0 on success, -1 on failure with errno set
+ */
+int applySched(pid_t tid, const schedSpec *spec, int stage);
+
+/**
+ * Get the settings of a thread
+ * @param tid thread ID, 0 for the calling thread
+ * @param mask set to the CPUs it may run on
+ * @param nice set to its nice value
+ * @param ioprio set to its I/O priority
+ * @return 0 on success, -1 if it is gone
+ */
+int getSched(pid_t tid, cpuMask mask, int *nice, int *ioprio);
+
+/**
+ * Format a mask as a CPU list like "0-3,8"
+ * @param mask mask
+ * @param buf buffer
+ * @param size size of buffer
+ * @return number of characters written
+ */
+int formatCpus(const unsigned long *mask, char *buf, size_t size);
+
+/**
+ * Format an I/O priority like "be:4" or "idle"
+ * @param ioprio class and level packed the way ioprio_set takes them
+ * @param buf buffer
+ * @param size size of buffer
+ * @return number of characters written
+ */
+int formatIoprio(int ioprio, char *buf, size_t size);
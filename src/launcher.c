@@ -0,0 +1,320 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "shell.h"
+#include "launcher.h"
+
+/* Socket to the launcher and its pid, -1 while it is not running */
+static int launcherFd = -1;
+static pid_t launcherPid = -1;
+
+/* Room for the descriptors of a request, aligned for cmsghdr */
+typedef union {
+	char buf[CMSG_SPACE(3 * sizeof(int))];
+	struct cmsghdr align;
+} launchControl;
+
+/**
+ * @brief Reads exactly len bytes
+ * 
+ * @param fd Descriptor to read from
+ * @param buf Buffer
+ * @param len Number of bytes
+ * @return 0 on success, -1 on error or end of file
+ */
+static int readAll(int fd, void *buf, size_t len) {
+	ssize_t n;
+
+	while(len > 0) {
+		if((n = read(fd, buf, len)) == -1 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			return -1;
+		buf = (char *)buf + n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * @brief Writes exactly len bytes to a socket, without SIGPIPE if the
+ * other end is gone
+ * 
+ * @param fd Socket to write to
+ * @param buf Data
+ * @param len Number of bytes
+ * @return 0 on success, -1 on error
+ */
+static int sendAll(int fd, const void *buf, size_t len) {
+	ssize_t n;
+
+	while(len > 0) {
+		if((n = send(fd, buf, len, MSG_NOSIGNAL)) == -1) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf = (const char *)buf + n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * @brief Sets up a process started by the launcher and executes its file
+ * 
+ * Does what forkProcess does in a child of the shell, from descriptors
+ * received with the request.
+ * 
+ * @param req Pointer to request
+ * @param file File to execute
+ * @param argv NULL terminated argument vector
+ * @param fds Standard input, standard output and working directory
+ */
+static void execRequest(launchRequest *req, char *file, char **argv, int *fds) {
+	/* Terminal signals are still ignored, as in the launcher */
+	if(req->flags & LAUNCH_SETPGID)
+		setpgid(0, req->pgid);
+	if(req->flags & LAUNCH_FOREGROUND)
+		tcsetpgrp(STDIN_FILENO, getpgrp());
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGTTIN, SIG_DFL);
+	signal(SIGTTOU, SIG_DFL);
+	sigprocmask(SIG_SETMASK, &req->mask, NULL);
+
+	if(fchdir(fds[2]) == -1 || dup2(fds[0], STDIN_FILENO) == -1 || dup2(fds[1], STDOUT_FILENO) == -1) {
+		perror(argv[0]);
+		_exit(EXIT_FAILURE);
+	}
+
+	/* Received descriptors are close-on-exec, only the dups stay */
+	execvp(file, argv);
+	perror(argv[0]);
+	_exit(127);
+}
+
+/**
+ * @brief Main loop of the launcher, which answers requests until the shell
+ * closes its end of the socket
+ * 
+ * Processes are created with CLONE_PARENT, which makes them children of
+ * the shell rather than of the launcher: the shell reaps them with wait4,
+ * moves them between process groups and hands them the terminal exactly as
+ * if it had forked them itself, while only the small address space of the
+ * launcher is copied.
+ * 
+ * @param sock Socket to the shell
+ */
+static void serveLaunches(int sock) {
+	launchControl control;
+	char *strings = NULL, **argv = NULL;
+	size_t maxLen = 0;
+	int maxArgs = 0, fds[3];
+	launchRequest req;
+	launchReply reply;
+	struct cmsghdr *cmsg;
+	ssize_t n;
+
+	while(1) {
+		struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+		struct msghdr msg = {
+			.msg_iov = &iov, .msg_iovlen = 1,
+			.msg_control = control.buf, .msg_controllen = sizeof(control.buf),
+		};
+
+		if((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+			continue;
+		if(n <= 0 || ((size_t)n < sizeof(req) && readAll(sock, (char *)&req + n, sizeof(req) - n) == -1))
+			_exit(EXIT_SUCCESS);
+
+		cmsg = CMSG_FIRSTHDR(&msg);
+		if(cmsg == NULL || cmsg->cmsg_type != SCM_RIGHTS || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)))
+			_exit(EXIT_FAILURE);
+		memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+		/* File and arguments, each NUL terminated */
+		if(req.len > maxLen) {
+			maxLen = req.len;
+			strings = realloc(strings, maxLen);
+		}
+		if(req.argc >= maxArgs) {
+			maxArgs = req.argc + 1;
+			argv = realloc(argv, maxArgs * sizeof(char *));
+		}
+		if(strings == NULL || argv == NULL || readAll(sock, strings, req.len) == -1)
+			_exit(EXIT_FAILURE);
+		argv[0] = strings + strlen(strings) + 1;
+		for(int i = 1; i < req.argc; i++)
+			argv[i] = argv[i - 1] + strlen(argv[i - 1]) + 1;
+		argv[req.argc] = NULL;
+
+		reply.pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, 0, 0, 0);
+		if(reply.pid == 0)
+			execRequest(&req, strings, argv, fds);
+		reply.err = reply.pid == -1 ? errno : 0;
+
+		for(int i = 0; i < 3; i++)
+			close(fds[i]);
+		if(sendAll(sock, &reply, sizeof(reply)) == -1)
+			_exit(EXIT_SUCCESS);
+	}
+}
+
+/**
+ * @brief Start the launcher, a small child of the shell that starts
+ * processes on its behalf
+ * 
+ * It is forked at startup, before history, caches and jobs make the shell
+ * grow, so that starting a process later copies none of them. It ignores
+ * the signals of the terminal, which are for the shell and its jobs.
+ * 
+ * @return 0 on success, -1 on failure
+ */
+int startLauncher() {
+	int sv[2];
+	pid_t pid;
+
+	if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+		return -1;
+
+	fflush(stdout);
+	if((pid = fork()) == -1) {
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	if(pid == 0) {
+		close(sv[0]);
+		signal(SIGINT, SIG_IGN);
+		signal(SIGTSTP, SIG_IGN);
+		signal(SIGQUIT, SIG_IGN);
+		signal(SIGTTIN, SIG_IGN);
+		signal(SIGTTOU, SIG_IGN);
+		serveLaunches(sv[1]);
+	}
+
+	close(sv[1]);
+	launcherFd = sv[0];
+	launcherPid = pid;
+	return 0;
+}
+
+/**
+ * @brief Start a process through the launcher, as a child of the shell
+ * 
+ * If the launcher is gone, the shell goes back to posix_spawn.
+ * 
+ * @param file File to execute, searched in PATH if it has no slash
+ * @param argv NULL terminated argument vector
+ * @param pgid Process group to join, 0 to lead a new one
+ * @param foreground Whether the job gets the terminal
+ * @param infd Descriptor to use as standard input
+ * @param outfd Descriptor to use as standard output
+ * @param mask Signal mask for the new process
+ * @return pid of the new process, -1 if it could not be started
+ */
+pid_t launcherSpawn(char *file, char **argv, pid_t pgid, bool foreground, int infd, int outfd, sigset_t *mask) {
+	launchControl control;
+	char *strings, *c;
+	launchRequest req = {
+		.pgid = pgid,
+		.flags = (interactive ? LAUNCH_SETPGID : 0) | (foreground ? LAUNCH_FOREGROUND : 0),
+		.mask = *mask,
+		.len = strlen(file) + 1,
+	};
+	struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+	struct msghdr msg = {
+		.msg_iov = &iov, .msg_iovlen = 1,
+		.msg_control = control.buf, .msg_controllen = sizeof(control.buf),
+	};
+	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+	int fds[3] = { infd, outfd, -1 };
+	launchReply reply;
+	bool sent;
+
+	/* The process starts in the directory the shell is in now */
+	if((fds[2] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) == -1) {
+		perror(argv[0]);
+		return -1;
+	}
+
+	for(req.argc = 0; argv[req.argc]; req.argc++)
+		req.len += strlen(argv[req.argc]) + 1;
+	if((strings = c = malloc(req.len)) == NULL) {
+		perror("launcher");
+		exit(EXIT_FAILURE);
+	}
+	c = stpcpy(c, file) + 1;
+	for(int i = 0; i < req.argc; i++)
+		c = stpcpy(c, argv[i]) + 1;
+
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	while(!(sent = sendmsg(launcherFd, &msg, MSG_NOSIGNAL) == sizeof(req)) && errno == EINTR)
+		;
+	sent = sent && sendAll(launcherFd, strings, req.len) == 0 && readAll(launcherFd, &reply, sizeof(reply)) == 0;
+	close(fds[2]);
+	free(strings);
+
+	if(!sent) {
+		fprintf(stderr, "fsh: launcher is gone, using posix_spawn\n");
+		stopLauncher();
+		launchMode = LAUNCH_SPAWN;
+		return launchProcess(file, argv, pgid, foreground, infd, outfd, mask);
+	}
+	if(reply.pid == -1) {
+		errno = reply.err;
+		perror(argv[0]);
+	}
+	return reply.pid;
+}
+
+/**
+ * @brief Stop the launcher
+ * 
+ * Closing the socket makes it exit. It is a child of the shell, so it is
+ * reaped here unless reapChildren already did.
+ * 
+ */
+void stopLauncher() {
+	if(launcherFd == -1)
+		return;
+	close(launcherFd);
+	waitpid(launcherPid, NULL, 0);
+	launcherFd = -1;
+	launcherPid = -1;
+}
+
+/**
+ * @brief Forget the launcher in a forked child of the shell
+ * 
+ * Processes the launcher starts are children of the shell, which a child
+ * running a builtin or a list could not wait for. It goes back to
+ * posix_spawn instead, leaving the launcher to the shell.
+ * 
+ */
+void dropLauncher() {
+	if(launcherFd == -1)
+		return;
+	close(launcherFd);
+	launcherFd = -1;
+	launcherPid = -1;
+	launchMode = LAUNCH_SPAWN;
+}
@@ -0,0 +1,58 @@
+/* Flags of a launch request */
+#define LAUNCH_SETPGID 1
+#define LAUNCH_FOREGROUND 2
+
+/**
+ * Request to start a process, followed on the socket by the file and
+ * argument strings, with the standard input, standard output and working
+ * directory of the process passed along as descriptors
+ */
+typedef struct {
+	/* Process group to join, 0 to lead a new one */
+	pid_t pgid;
+	int flags;
+	/* Signal mask of the new process */
+	sigset_t mask;
+	/* Number of arguments, and bytes of the strings following */
+	int argc;
+	size_t len;
+} launchRequest;
+
+/* Answer of the launcher to a request */
+typedef struct {
+	/* pid of the new process, -1 if it could not be started */
+	pid_t pid;
+	/* errno of the failure */
+	int err;
+} launchReply;
+
+/**
+ * Start the launcher, a small child of the shell that starts processes
+ * on its behalf
+ * @return 0 on success, -1 on failure
+ */
+int startLauncher();
+
+/**
+ * Start a process through the launcher, as a child of the shell
+ * @param file file to execute, searched in PATH if it has no slash
+ * @param argv NULL terminated argument vector
+ * @param pgid process group to join, 0 to lead a new one
+ * @param foreground whether the job gets the terminal
+ * @param infd descriptor to use as standard input
+ * @param outfd descriptor to use as standard output
+ * @param mask signal mask for the new process
+ * @return pid of the new process, -1 if it could not be started
+ */
+pid_t launcherSpawn(char *file, char **argv, pid_t pgid, bool foreground, int infd, int outfd, sigset_t *mask);
+
+/**
+ * Stop the launcher
+ */
+void stopLauncher();
+
+/**
+ * Forget the launcher in a forked child of the shell, which has to start
+ * its processes itself to be their parent
+ */
+void dropLauncher();
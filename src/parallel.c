@@ -0,0 +1,436 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "shell.h"
+#include "input.h"
+#include "parallel.h"
+#include "jobsched.h"
+#include "trace.h"
+#include "wildcard.h"
+
+/* Runs started with & that still have tasks going */
+static parallelRun *runs = NULL;
+
+/**
+ * @brief Replaces every {} in a word of the command with the item
+ * 
+ * @param mem Arena of the task
+ * @param word Word of the command
+ * @param item Item of the task
+ * @param placed Set to true if the word had a {}
+ * @return Copy of word in the arena
+ */
+static char *substitute(arena *mem, char *word, char *item, bool *placed) {
+	size_t count = 0, itemLen = strlen(item);
+	char *c, *res, *out;
+
+	for(c = strstr(word, "{}"); c; c = strstr(c + 2, "{}"))
+		count++;
+	if(count == 0)
+		return arenaStrdup(mem, word);
+
+	*placed = true;
+	out = res = arenaAlloc(mem, strlen(word) - 2 * count + count * itemLen + 1);
+	while((c = strstr(word, "{}"))) {
+		out = mempcpy(out, word, c - word);
+		out = mempcpy(out, item, itemLen);
+		word = c + 2;
+	}
+	strcpy(out, word);
+	return res;
+}
+
+/**
+ * @brief Builds the command table of a task
+ * 
+ * The item goes wherever the command has {}, or after its last word if
+ * it has none. The table is built directly rather than by parsing, so
+ * items with blanks or special characters stay one argument.
+ * 
+ * @param run Pointer to run
+ * @param item Item of the task
+ * @return Pointer to command table
+ */
+static cmdTable *makeTask(parallelRun *run, char *item) {
+	cmdTable *task = malloc(sizeof(cmdTable));
+	bool placed = false;
+	size_t len = 0;
+	char **argv, *c;
+	int argc = 0;
+
+	if(task == NULL) {
+		perror("parallel");
+		exit(EXIT_FAILURE);
+	}
+	initCmdTable(task);
+
+	task->args = arenaAlloc(&task->mem, sizeof(char **));
+	argv = task->args[0] = arenaAlloc(&task->mem, (run->commandLen + 2) * sizeof(char *));
+	for(int i = 0; i < run->commandLen; i++)
+		argv[argc++] = substitute(&task->mem, run->command[i], item, &placed);
+	if(!placed)
+		argv[argc++] = arenaStrdup(&task->mem, item);
+	argv[argc] = NULL;
+
+	/* Command line shown by jobs */
+	for(int i = 0; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+	task->cmdLine = c = arenaAlloc(&task->mem, len);
+	for(int i = 0; i < argc; i++) {
+		c = stpcpy(c, argv[i]);
+		*c++ = ' ';
+	}
+	c[-1] = '\0';
+
+	task->numCmds = 1;
+	if(run->cmdTab->sched)
+		task->sched = copySched(&task->mem, run->cmdTab->sched);
+	/* Tasks of a run reading its items from the terminal do not get it */
+	task->isbackground = !run->foreground;
+	return task;
+}
+
+/**
+ * @brief Gets the item of the next task
+ * 
+ * Items from input are read one at a time as tasks are started, so no
+ * more of them than there are running tasks are ever held in memory.
+ * 
+ * @param run Pointer to run
+ * @return Item, NULL if there are no more
+ */
+static char *nextItem(parallelRun *run) {
+	char *item = NULL;
+
+	if(run->exhausted)
+		return NULL;
+
+	if(run->items) {
+		if(*run->items)
+			item = *run->items++;
+	}
+	else {
+		item = readLine(&run->input);
+	}
+
+	if(item == NULL)
+		run->exhausted = true;
+	return item;
+}
+
+/**
+ * @brief Starts a task for the next item
+ * 
+ * @param run Pointer to run
+ * @return false if there are no more items, true otherwise
+ */
+static bool startTask(parallelRun *run) {
+	char *item = nextItem(run);
+	pid_t pgid = 0;
+	job *j;
+
+	if(item == NULL)
+		return false;
+	run->numStarted++;
+
+	/* A new process group is led only once the old one has no members left */
+	if(run->foreground && run->numTasks > 0)
+		pgid = run->pgid;
+
+	if((j = launchJob(makeTask(run, item), run->infd, run->outfd, pgid)) == NULL) {
+		run->numFailed++;
+		return true;
+	}
+	j->status = run->background ? BG : FG;
+	j->runner = run;
+	run->tasks[run->numTasks++] = j;
+
+	if(run->foreground && pgid == 0) {
+		run->pgid = j->pgid;
+		tcsetpgrp(STDIN_FILENO, run->pgid);
+		traceTerminal(run->pgid);
+	}
+	return true;
+}
+
+/**
+ * @brief Starts tasks until maxTasks of them are running
+ * 
+ * @param run Pointer to run
+ */
+static void fillRun(parallelRun *run) {
+	while(!run->interrupted && run->numTasks < run->maxTasks && startTask(run))
+		;
+}
+
+/**
+ * @brief Reports the exit status of every completed task and removes it
+ * 
+ * @param run Pointer to run
+ * @return Number of tasks reported
+ */
+static int finishTasks(parallelRun *run) {
+	int reported = 0, status;
+	job *j;
+
+	for(int i = 0; i < run->numTasks; i++) {
+		j = run->tasks[i];
+		if(j->numProcs > 0)
+			continue;
+
+		status = jobStatus(j);
+		if(status != 0)
+			run->numFailed++;
+		if(status == 128 + SIGINT)
+			run->interrupted = true;
+		printf("[%d]\tExit %d\t\t\"%s\"\n", j->id, status, j->cmdTab->cmdLine);
+
+		removeJob(j);
+		run->tasks[i--] = run->tasks[--run->numTasks];
+		reported++;
+	}
+	return reported;
+}
+
+/**
+ * @brief Frees a run and releases its command table
+ * 
+ * Tasks still running stay in jobs table as jobs of the shell.
+ * 
+ * @param run Pointer to run
+ */
+static void freeRun(parallelRun *run) {
+	for(int i = 0; i < run->numTasks; i++)
+		run->tasks[i]->runner = NULL;
+
+	if(run->infd != STDIN_FILENO)
+		close(run->infd);
+	if(run->outfd != STDOUT_FILENO)
+		close(run->outfd);
+	closeReader(&run->input);
+
+	releaseCmdTable(run->cmdTab);
+	arenaFree(&run->mem);
+	free(run->tasks);
+	free(run);
+}
+
+/**
+ * @brief Exit status of a run
+ * 
+ * @param run Pointer to run
+ * @return 130 if it was interrupted, number of failed tasks otherwise
+ */
+static int runStatus(parallelRun *run) {
+	if(run->interrupted)
+		return 128 + SIGINT;
+	return run->numFailed < PARALLEL_MAX_FAILED ? run->numFailed : PARALLEL_MAX_FAILED;
+}
+
+/**
+ * @brief Runs a command for every item, some of them at once
+ * 
+ * "parallel -j N command {} ::: items" keeps N tasks running, starting
+ * the next one as soon as one is reaped, and prints the exit status of
+ * every task. Without ::: the items are the lines of the input file, or
+ * of standard input. Tasks are jobs of the shell started with
+ * launchJob(), so with & the run goes on in background and its tasks
+ * show up in jobs.
+ * 
+ * As a stage of a pipeline, e.g. "ls | parallel gzip", it runs in a child
+ * of its own like any builtin there, whose standard input and output are
+ * already the pipes and files of the stage, and waits for its tasks.
+ * 
+ * @param args NULL terminated argument vector of its stage
+ * @param cmdTab Pointer to command table, owned by the run from now on
+ */
+void parallel(char **args, cmdTable *cmdTab) {
+	long maxTasks = sysconf(_SC_NPROCESSORS_ONLN);
+	bool stage = cmdTab->numCmds > 1;
+	parallelRun *run;
+	char *value, *end;
+	job *j;
+	int i;
+
+	for(i = 1; args[i] && args[i][0] == '-'; i++) {
+		if(strcmp(args[i], "-j") == 0 && args[i + 1])
+			value = args[++i];
+		else if(strncmp(args[i], "-j", 2) == 0 && args[i][2])
+			value = args[i] + 2;
+		else
+			break;
+		maxTasks = strtol(value, &end, 10);
+		if(end == value || *end || maxTasks < 1 || maxTasks > PARALLEL_MAX_TASKS) {
+			fprintf(stderr, "parallel: %s: tasks must be from 1 to %d\n", value, PARALLEL_MAX_TASKS);
+			lastStatus = 2;
+			releaseCmdTable(cmdTab);
+			return;
+		}
+	}
+	if(args[i] == NULL || args[i][0] == '-' || strcmp(args[i], ":::") == 0) {
+		fprintf(stderr, PARALLEL_USAGE);
+		lastStatus = 2;
+		releaseCmdTable(cmdTab);
+		return;
+	}
+
+	run = calloc(1, sizeof(parallelRun));
+	if(run == NULL) {
+		perror("parallel");
+		exit(EXIT_FAILURE);
+	}
+	run->cmdTab = cmdTab;
+	/* Words with wildcards become the files they match, in the arena of
+	   the run as the table may be cached. Options have none, so the
+	   command is still at i. In a pipeline they were expanded already */
+	if(cmdTab->globs && !stage)
+		args = expandWildcards(args, &run->mem);
+	run->command = &args[i];
+	for(; args[i] && strcmp(args[i], ":::") != 0; i++)
+		run->commandLen++;
+	if(args[i])
+		run->items = &args[i + 1];
+	run->maxTasks = maxTasks;
+	if((run->tasks = malloc(maxTasks * sizeof(job *))) == NULL) {
+		perror("parallel");
+		exit(EXIT_FAILURE);
+	}
+	/* In a pipeline the whole job is in background, not the run */
+	run->background = cmdTab->isbackground && !stage;
+	run->infd = STDIN_FILENO;
+	run->outfd = STDOUT_FILENO;
+
+	/* Without ::: the input file or here-document gives the items, with it
+	   the input of tasks */
+	if((cmdTab->heredoc || cmdTab->heredocEnd) && !stage) {
+		if((run->infd = openHeredoc(cmdTab)) == -1) {
+			perror("heredoc");
+			run->infd = STDIN_FILENO;
+			lastStatus = 1;
+			freeRun(run);
+			return;
+		}
+	}
+	else if(cmdTab->infile && !stage) {
+		run->infd = open(cmdTab->infile, READ_FLAGS | O_CLOEXEC, READ_MODES);
+		if(run->infd == -1) {
+			perror(cmdTab->infile);
+			run->infd = STDIN_FILENO;
+			lastStatus = 1;
+			freeRun(run);
+			return;
+		}
+	}
+	if(cmdTab->outfile && !stage) {
+		run->outfd = open(cmdTab->outfile, CREATE_FLAGS | O_CLOEXEC, CREATE_MODES);
+		if(run->outfd == -1) {
+			perror(cmdTab->outfile);
+			run->outfd = STDOUT_FILENO;
+			lastStatus = 1;
+			freeRun(run);
+			return;
+		}
+	}
+	if(run->items == NULL) {
+		if(run->background && run->infd == STDIN_FILENO) {
+			fprintf(stderr, "parallel: items must follow ::: or come from a file with &\n");
+			lastStatus = 2;
+			freeRun(run);
+			return;
+		}
+		openReader(&run->input, run->infd);
+		run->infd = open("/dev/null", READ_FLAGS | O_CLOEXEC);
+		if(run->infd == -1) {
+			perror("/dev/null");
+			run->infd = STDIN_FILENO;
+		}
+	}
+
+	/* Tasks cannot have the terminal while items are read from it */
+	run->foreground = interactive && !run->background && (run->items || run->input.fd != STDIN_FILENO);
+	if(interactive)
+		signal(SIGTTOU, SIG_IGN);
+
+	if(run->background) {
+		fillRun(run);
+		if(run->numTasks == 0) {
+			lastStatus = runStatus(run);
+			freeRun(run);
+			return;
+		}
+		run->next = runs;
+		runs = run;
+		lastStatus = 0;
+		return;
+	}
+
+	while(1) {
+		finishTasks(run);
+		fillRun(run);
+		if(run->numTasks == 0)
+			break;
+
+		/* Tasks stopped with Ctrl-Z are continued, the run cannot be stopped */
+		if((j = waitForAnyJob(run->tasks, run->numTasks)) == NULL)
+			break;
+		if(j->status == STOPPED) {
+			kill(-j->pgid, SIGCONT);
+			traceContinue(j->pgid);
+			j->status = FG;
+		}
+	}
+
+	if(run->foreground) {
+		tcsetpgrp(STDIN_FILENO, getpgid(getpid()));
+		traceTerminal(getpgid(getpid()));
+	}
+	lastStatus = runStatus(run);
+	freeRun(run);
+}
+
+/**
+ * @brief Moves background runs along
+ * 
+ * Runs from the event loop after children were reaped: completed tasks
+ * are reported, the next ones started, and finished runs summed up.
+ * 
+ * @return Number of messages printed
+ */
+int pollParallel() {
+	parallelRun **link = &runs, *run;
+	int reported = 0;
+
+	while((run = *link)) {
+		reported += finishTasks(run);
+		fillRun(run);
+		if(run->numTasks > 0) {
+			link = &run->next;
+			continue;
+		}
+
+		printf("[parallel]\tDone\t\t%d tasks, %d failed\t\t\"%s\"\n", run->numStarted, run->numFailed, run->cmdTab->cmdLine);
+		reported++;
+		*link = run->next;
+		freeRun(run);
+	}
+	return reported;
+}
+
+/**
+ * @brief Frees every background run
+ * 
+ */
+void freeParallel() {
+	parallelRun *next;
+
+	for(; runs; runs = next) {
+		next = runs->next;
+		freeRun(runs);
+	}
+}
@@ -0,0 +1,64 @@
+/* Usage message of the parallel builtin */
+#define PARALLEL_USAGE "usage: parallel [-j N] command [args] [::: items]\n"
+
+/* Most tasks a run may keep going at once */
+#define PARALLEL_MAX_TASKS 4096
+
+/* Exit status of a run is the number of failed tasks, up to this */
+#define PARALLEL_MAX_FAILED 101
+
+/**
+ * State of the parallel builtin, which runs a command for every item
+ * with at most maxTasks of them running at a time
+ */
+typedef struct parallelRun {
+	/* Command table of the parallel line, holding the command and items */
+	cmdTable *cmdTab;
+	/* Words of the line with wildcards expanded, if it had any */
+	arena mem;
+	/* Words of the command to run, where {} stands for the item */
+	char **command;
+	int commandLen;
+	/* Items given after :::, NULL if they are read from input */
+	char **items;
+	inputReader input;
+	/* No items left to start tasks for */
+	bool exhausted;
+	/* Running tasks, at most maxTasks of them */
+	job **tasks;
+	int numTasks;
+	int maxTasks;
+	/* Tasks share a process group which is given the terminal, so that
+	 * Ctrl-C reaches them */
+	bool foreground;
+	pid_t pgid;
+	/* Standard input and output of every task */
+	int infd;
+	int outfd;
+	int numStarted;
+	int numFailed;
+	/* A task was killed by Ctrl-C, so no more are started */
+	bool interrupted;
+	bool background;
+	/* Next background run */
+	struct parallelRun *next;
+} parallelRun;
+
+/**
+ * The parallel builtin, which blocks until all tasks are done unless the
+ * line ends with &
+ * @param argv NULL terminated argument vector of its stage
+ * @param cmdTab pointer to parsed command table, owned by the run from now on
+ */
+void parallel(char **argv, cmdTable *cmdTab);
+
+/**
+ * Report completed tasks of background runs and start the next ones
+ * @return number of messages printed
+ */
+int pollParallel();
+
+/**
+ * Free every background run, leaving their tasks in jobs table
+ */
+void freeParallel();
@@ -2,7 +2,88 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
+#include <sys/stat.h>
 #include "parse.h"
+#include "jobsched.h"
+#include "wildcard.h"
+
+/**
+ * @brief Make sure the newest block of an arena has room for size bytes
+ * 
+ * When it does not, a new block twice as large as the last one (or large
+ * enough for size) is chained in front, so a caller that knows how much a
+ * command line needs gets all of it from a single malloc.
+ * 
+ * @param mem Pointer to arena
+ * @param size Number of bytes needed
+ */
+void arenaReserve(arena *mem, size_t size) {
+	arenaBlock *block = mem->head;
+
+	if(block && block->size - block->used >= size)
+		return;
+
+	size_t blockSize = block ? 2 * block->size : ARENA_BLOCK_SIZE;
+	while(blockSize < size)
+		blockSize *= 2;
+
+	block = malloc(sizeof(arenaBlock) + blockSize);
+	if(block == NULL) {
+		perror("arenaReserve");
+		exit(EXIT_FAILURE);
+	}
+	block->next = mem->head;
+	block->size = blockSize;
+	block->used = 0;
+	mem->head = block;
+}
+
+/**
+ * @brief Allocate memory from an arena
+ * 
+ * Memory is handed out from the newest block. It is never freed on its
+ * own, only together with the whole arena.
+ * 
+ * @param mem Pointer to arena
+ * @param size Number of bytes needed
+ * @return Pointer to uninitialised memory aligned for any pointer
+ */
+void *arenaAlloc(arena *mem, size_t size) {
+	size = ARENA_ALIGN(size);
+	arenaReserve(mem, size);
+
+	void *ptr = mem->head->data + mem->head->used;
+	mem->head->used += size;
+	return ptr;
+}
+
+/**
+ * @brief Duplicate a string into an arena
+ * 
+ * @param mem Pointer to arena
+ * @param str String to be copied
+ * @return Pointer to the copy
+ */
+char *arenaStrdup(arena *mem, const char *str) {
+	size_t len = strlen(str) + 1;
+	return memcpy(arenaAlloc(mem, len), str, len);
+}
+
+/**
+ * @brief Free all blocks of an arena
+ * 
+ * @param mem Pointer to arena
+ */
+void arenaFree(arena *mem) {
+	arenaBlock *block = mem->head, *next;
+	while(block) {
+		next = block->next;
+		free(block);
+		block = next;
+	}
+	mem->head = NULL;
+}
 
 /**
  * @brief Initialise the command table
@@ -12,15 +93,22 @@
 void initCmdTable(cmdTable *cmdTab) {
 	debug_printf("%s\n", "initCmdTable: Entered");
 
-	for(int i = 0; i < MAX_CMDS; i++)
-		for(int j = 0; j < ARGS_SIZE; j++)
-			cmdTab->args[i][j] = NULL;
-
+	cmdTab->mem.head = NULL;
 	cmdTab->cmdLine = NULL;
+	cmdTab->args = NULL;
 	cmdTab->infile = NULL;
 	cmdTab->outfile = NULL;
+	cmdTab->heredoc = NULL;
+	cmdTab->heredocLen = 0;
+	cmdTab->heredocEnd = NULL;
 	cmdTab->isbackground = false;
+	cmdTab->timed = false;
+	cmdTab->globs = false;
+	cmdTab->sched = NULL;
+	cmdTab->substs = NULL;
+	cmdTab->numSubsts = 0;
 	cmdTab->numCmds = 0;
+	cmdTab->refs = 1;
 
 	debug_printf("%s\n", "initCmdTable: Exited");
 }
@@ -33,54 +121,303 @@ void initCmdTable(cmdTable *cmdTab) {
 void freeCmdTable(cmdTable *cmdTab) {
 	debug_printf("%s\n", "freeCmdTable: Entered");
 
-	int argsRow, argsCol;
-	for(argsRow = 0; argsRow < cmdTab->numCmds; argsRow++) {
-		argsCol = 0;
-		while(cmdTab->args[argsRow][argsCol]) {
-			free(cmdTab->args[argsRow][argsCol]);
-			argsCol++;
+	/* Tables of substitutions own arenas of their own */
+	for(int i = 0; i < cmdTab->numSubsts; i++)
+		freeCmdTable(cmdTab->substs[i].cmdTab);
+	arenaFree(&cmdTab->mem);
+	cmdTab->cmdLine = NULL;
+	cmdTab->args = NULL;
+	cmdTab->infile = NULL;
+	cmdTab->outfile = NULL;
+	cmdTab->heredoc = NULL;
+	cmdTab->heredocLen = 0;
+	cmdTab->heredocEnd = NULL;
+	cmdTab->timed = false;
+	cmdTab->globs = false;
+	cmdTab->sched = NULL;
+	cmdTab->substs = NULL;
+	cmdTab->numSubsts = 0;
+	cmdTab->numCmds = 0;
+
+	debug_printf("%s\n", "freeCmdTable: Exited");
+}
+
+/**
+ * @brief Take a reference to a command table allocated with malloc
+ * 
+ * A parsed command table is not changed afterwards, so the parse cache,
+ * a job and the executor can share it.
+ * 
+ * @param cmdTab Pointer to command table
+ * @return cmdTab
+ */
+cmdTable *holdCmdTable(cmdTable *cmdTab) {
+	cmdTab->refs++;
+	return cmdTab;
+}
+
+/**
+ * @brief Drop a reference to a command table allocated with malloc,
+ * freeing it with the last one
+ * 
+ * @param cmdTab Pointer to command table
+ */
+void releaseCmdTable(cmdTable *cmdTab) {
+	if(--cmdTab->refs > 0)
+		return;
+	freeCmdTable(cmdTab);
+	free(cmdTab);
+}
+
+/**
+ * @brief Finds the ) closing a process substitution
+ * 
+ * @param c Pointer to the ( opening it
+ * @return Pointer to the matching ), NULL if there is none
+ */
+static char *closeParen(char *c) {
+	int depth = 0;
+
+	for(; *c && *c != '\n'; c++) {
+		if(*c == '(')
+			depth++;
+		else if(*c == ')' && --depth == 0)
+			return c;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Allocate the argument vectors of the command table
+ * 
+ * Counts the commands in the line and the arguments of each one (words
+ * not following a redirection operator), and the process substitutions. A first pass reserves everything
+ * the line needs in the arena, the second carves out every argument
+ * vector at its exact length. Syntax errors are left for the state
+ * machine to report.
+ * 
+ * @param cmdLine Pointer to line to be parsed
+ * @param len Length of the line including its terminator
+ * @param cmdTab Pointer to command table
+ */
+static void allocArgs(char *cmdLine, size_t len, cmdTable *cmdTab) {
+	int numCmds = 0, numArgs = 0, numSubsts = 0, argsRow = 0, argc = 0;
+	bool inWord = false, isFile = false;
+	char *c, *end;
+
+	for(int pass = 0; pass < 2; pass++) {
+		for(c = cmdLine; ; c++) {
+			/* A process substitution is a single argument, whatever it holds */
+			if(!inWord && IS_SUBST(c)) {
+				if(!isFile)
+					argc++;
+				if(pass == 0)
+					numSubsts++;
+				end = closeParen(c + 1);
+				c = end ? end : c + strlen(c) - 1;
+				isFile = false;
+				continue;
+			}
+
+			if(IS_NORMAL(*c)) {
+				if(!inWord && !isFile)
+					argc++;
+				inWord = true;
+				continue;
+			}
+
+			if(inWord)
+				isFile = false;
+			inWord = false;
+
+			if(IS_INPUT(*c) || IS_OUTPUT(*c)) {
+				isFile = true;
+			}
+			else if(IS_PIPE(*c) || IS_NULL(*c)) {
+				if(pass == 0) {
+					numCmds++;
+					numArgs += argc;
+				}
+				else {
+					cmdTab->args[argsRow] = arenaAlloc(&cmdTab->mem, (argc + 1) * sizeof(char *));
+					memset(cmdTab->args[argsRow], 0, (argc + 1) * sizeof(char *));
+					argsRow++;
+				}
+				argc = 0;
+				isFile = false;
+				if(IS_NULL(*c))
+					break;
+			}
+		}
+
+		if(pass == 0) {
+			/* Display copy and token copy of the line, then the vectors */
+			arenaReserve(&cmdTab->mem, 2 * ARENA_ALIGN(len) +
+				ARENA_ALIGN(numCmds * sizeof(char **)) +
+				(numArgs + numCmds) * sizeof(char *));
+			cmdTab->args = arenaAlloc(&cmdTab->mem, numCmds * sizeof(char **));
+			if(numSubsts)
+				cmdTab->substs = arenaAlloc(&cmdTab->mem, numSubsts * sizeof(procSubst));
 		}
 	}
-	free(cmdTab->cmdLine);
-	free(cmdTab->infile);
-	free(cmdTab->outfile);
+}
 
-	debug_printf("%s\n", "freeCmdTable: Exited");
+static char *nextOperator(char *c);
+
+/**
+ * @brief Parses a process substitution <(cmd) or >(cmd) into a command
+ * table of its own, recorded as an argument of the current command
+ * 
+ * The argument keeps the text of the substitution until the executor
+ * replaces it with the path of a pipe. On a syntax error the command
+ * table is freed.
+ * 
+ * @param cmdTab Pointer to command table
+ * @param line Private copy of the line being parsed
+ * @param i Index of the < or > starting it, set to that of the )
+ * @param row Index of the command it is an argument of
+ * @param col Index of the argument
+ * @return true if it was parsed successfully, false otherwise
+ */
+static bool parseSubst(cmdTable *cmdTab, char *line, size_t *i, int row, int col) {
+	char *start = &line[*i], *end = closeParen(start + 1);
+	procSubst *subst;
+	cmdTable *inner;
+
+	if(end == NULL) {
+		printf("Parse Error: Missing ).\n");
+		freeCmdTable(cmdTab);
+		return false;
+	}
+
+	cmdTab->args[row][col] = memcpy(arenaAlloc(&cmdTab->mem, end - start + 2), start, end - start + 1);
+	cmdTab->args[row][col][end - start + 1] = '\0';
+
+	inner = arenaAlloc(&cmdTab->mem, sizeof(cmdTable));
+	initCmdTable(inner);
+	subst = &cmdTab->substs[cmdTab->numSubsts++];
+	subst->cmd = row;
+	subst->arg = col;
+	subst->output = IS_OUTPUT(*start);
+	subst->cmdTab = inner;
+
+	/* Its processes are part of the job of the outer command, so it is a
+	   single pipeline */
+	*end = '\0';
+	if(*nextOperator(start + 2) != '\0') {
+		printf("Parse Error: Unexpected syntax encountered.\n");
+		freeCmdTable(cmdTab);
+		return false;
+	}
+	if(!parse(start + 2, inner)) {
+		freeCmdTable(cmdTab);
+		return false;
+	}
+	/* The lines after the line are for the here-documents of the line */
+	if(inner->heredocEnd) {
+		printf("Parse Error: Unexpected syntax encountered.\n");
+		freeCmdTable(cmdTab);
+		return false;
+	}
+	*i = end - line;
+	return true;
+}
+
+/**
+ * @brief Take off the time and sched prefixes, check that no command of
+ * the parsed table is empty and note words with wildcards
+ * 
+ * Catches lines like "ls |", "| wc" or "time | wc" which the state machine
+ * accepts. A lone "time" is allowed and times nothing.
+ * 
+ * @param cmdTab Pointer to command table
+ * @return true if every command has a program name, false otherwise
+ */
+static bool checkCmds(cmdTable *cmdTab) {
+	char **first = cmdTab->args[0];
+
+	/* The time prefix reports on the whole pipeline after it */
+	if(cmdTab->args[0][0] && strcmp(cmdTab->args[0][0], "time") == 0) {
+		cmdTab->timed = true;
+		cmdTab->args[0]++;
+		if(cmdTab->numCmds == 1 && cmdTab->args[0][0] == NULL)
+			return true;
+	}
+
+	/* The sched prefix sets CPUs and priorities of the pipeline after it */
+	if(cmdTab->args[0][0] && strcmp(cmdTab->args[0][0], "sched") == 0 && !parseSched(cmdTab)) {
+		freeCmdTable(cmdTab);
+		return false;
+	}
+
+	/* Substitutions of the first command count from after the prefixes,
+	   whose options cannot be one */
+	for(int i = 0; i < cmdTab->numSubsts; i++) {
+		if(cmdTab->substs[i].cmd == 0 && (cmdTab->substs[i].arg -= cmdTab->args[0] - first) < 0) {
+			printf("Parse Error: Unexpected syntax encountered.\n");
+			freeCmdTable(cmdTab);
+			return false;
+		}
+	}
+
+	for(int i = 0; i < cmdTab->numCmds; i++) {
+		if(cmdTab->args[i][0] == NULL) {
+			printf("Parse Error: Missing command.\n");
+			freeCmdTable(cmdTab);
+			return false;
+		}
+		/* Words are only expanded when run, as the files they match change */
+		for(int j = 0; cmdTab->args[i][j] && !cmdTab->globs; j++)
+			cmdTab->globs = hasWildcards(cmdTab->args[i][j]);
+	}
+	return true;
 }
 
 /**
  * @brief Parse the command line and insert into command table
  * 
- * Following a state machine, the parser tokenizes the string based on 6 states:
+ * Following a state machine, the parser tokenizes a private copy of the string
+ * in place, ending every token with a NUL and pointing the command table at
+ * it, so no token is ever allocated on its own. It is based on 6 states:
  * 1. INIT - The state machine starts in this state
  * 2. ARGS - When inside an argument (includes process name)
- * 3. CMD - When not in any other state
- * 4. SPECIAL - When any of the special operators is encountered (<, >, |)
+ * 3. CMD - When not in any other state, where <( or >( starts a process
+ * substitution, parsed on its own
+ * 4. SPECIAL - When any of the special operators is encountered (<, >, |),
+ * where << and <<< make the word after them the end of a here-document or
+ * a here-string
  * 5. AMPERSAND - When next character is &
- * 6. FILENAME - When parsing a file name for input or output
+ * 6. FILENAME - When parsing a file name for input or output, or a word
+ * after << or <<<
+ * 
+ * On a syntax error the command table is freed.
  * 
  * @param cmdLine Pointer to line to be parsed
  * @param cmdTab Pointer to command table to store into
+ * @return true if the line was parsed successfully, false otherwise
  * @see cmdTable
  */
-void parse(char *cmdLine, cmdTable *cmdTab) {
+bool parse(char *cmdLine, cmdTable *cmdTab) {
 	debug_printf("parse: %s\n", cmdLine);
 
 	register char c;
-	int i = 0, tokenIdx = 0, argsRow = 0, argsCol = 0;
-	char *token = malloc(1024 * sizeof(char));
+	int argsRow = 0, argsCol = 0;
+	size_t i = 0, len = strlen(cmdLine) + 1;
+	char *line, *token = NULL;
 	State currentState = INIT;
 	ArgType argExpected = COMMAND;
-	cmdTab->cmdLine = strdup(cmdLine);
+	allocArgs(cmdLine, len, cmdTab);
+	cmdTab->cmdLine = memcpy(arenaAlloc(&cmdTab->mem, len), cmdLine, len);
+	line = memcpy(arenaAlloc(&cmdTab->mem, len), cmdLine, len);
 
 	while(1) {
-		c = cmdLine[i];
+		c = line[i];
 		debug_printf("parse: char %c currentState %d\n", c, currentState);
 
 		switch(currentState) {
 			case INIT:
 				if(IS_NORMAL(c)) {
-					token[tokenIdx++] = c;
+					token = &line[i];
 					currentState = ARGS;
 				}
 				else if(IS_WHITESPACE(c)){
@@ -89,61 +426,55 @@ void parse(char *cmdLine, cmdTable *cmdTab) {
 				else {
 					printf("Parse Error: Unexpected syntax encountered.\n");
 					debug_printf("%s\n", "parse: Exited");
-					free(token);
 					freeCmdTable(cmdTab);
-					return;
+					return false;
 				}
 				break;
 
 			case ARGS:
 				if(IS_WHITESPACE(c)) {
-					token[tokenIdx] = '\0';
+					line[i] = '\0';
 					debug_printf("parse: token <%s> formed\n", token);
 
-					cmdTab->args[argsRow][argsCol] = strdup(token);
+					cmdTab->args[argsRow][argsCol] = token;
 					argsCol++;
-					tokenIdx = 0;
 					currentState = CMD;
 				}
 				else if(IS_INPUT(c) || IS_OUTPUT(c) || IS_PIPE(c)) {
-					token[tokenIdx] = '\0';
+					line[i] = '\0';
 					debug_printf("parse: token <%s> formed\n", token);
-					cmdTab->args[argsRow][argsCol] = strdup(token);
+					cmdTab->args[argsRow][argsCol] = token;
 					argsCol++;
-					tokenIdx = 0;
 					currentState = SPECIAL;
 					if(IS_INPUT(c))
 						argExpected = INFILE;
 					if(IS_OUTPUT(c))
 						argExpected = OUTFILE;
 					if(IS_PIPE(c)) {
-						currentState = ARGS;
+						currentState = CMD;
 						argsCol = 0;
 						argsRow++;
 					}
 				}
 				else if(IS_NORMAL(c)) {
-					token[tokenIdx++] = c;
+					;
 				}
 				else if(IS_NULL(c)) {
-					token[tokenIdx] = '\0';
+					line[i] = '\0';
 					debug_printf("parse: token <%s> formed\n", token);
 
-					cmdTab->args[argsRow][argsCol] = strdup(token);
+					cmdTab->args[argsRow][argsCol] = token;
 					argsCol = 0;
-					tokenIdx = 0;
 					argsRow++;
 					cmdTab->numCmds = argsRow;
-					free(token);
 					debug_printf("%s %d\n", "parse: Exited", argsRow);
-					return;
+					return checkCmds(cmdTab);
 				}
 				else if(IS_AMPERSAND(c)) {
-					token[tokenIdx] = '\0';
+					line[i] = '\0';
 					debug_printf("parse: token <%s> formed\n", token);
-					cmdTab->args[argsRow][argsCol] = strdup(token);
+					cmdTab->args[argsRow][argsCol] = token;
 					argsCol++;
-					tokenIdx = 0;
 					cmdTab->isbackground = true;
 					currentState = AMPERSAND;
 				}
@@ -153,6 +484,11 @@ void parse(char *cmdLine, cmdTable *cmdTab) {
 				if(IS_WHITESPACE(c)) {
 					;
 				}
+				else if(IS_SUBST(&line[i])) {
+					if(!parseSubst(cmdTab, line, &i, argsRow, argsCol))
+						return false;
+					argsCol++;
+				}
 				else if(IS_INPUT(c) || IS_OUTPUT(c) || IS_PIPE(c)) {
 					currentState = SPECIAL;
 					if(IS_INPUT(c))
@@ -167,15 +503,14 @@ void parse(char *cmdLine, cmdTable *cmdTab) {
 					}
 				}
 				else if(IS_NORMAL(c)) {
-					token[tokenIdx++] = c;
+					token = &line[i];
 					currentState = ARGS;
 				}
 				else if(IS_NULL(c)) {
 					argsRow++;
 					cmdTab->numCmds = argsRow;
-					free(token);
 					debug_printf("%s\n", "parse: Exited");
-					return;
+					return checkCmds(cmdTab);
 				}
 				else if(IS_AMPERSAND(c)) {
 					cmdTab->isbackground = true;
@@ -187,23 +522,25 @@ void parse(char *cmdLine, cmdTable *cmdTab) {
 				if(IS_WHITESPACE(c)) {
 					;
 				}
+				else if(IS_INPUT(c) && cmdTab->cmdLine[i - 1] == '<' && (argExpected == INFILE || argExpected == HEREDOC)) {
+					/* << starts a here-document, <<< a here-string */
+					argExpected = argExpected == INFILE ? HEREDOC : HERESTRING;
+				}
 				else if(IS_INPUT(c) || IS_OUTPUT(c) || IS_PIPE(c)) {
 					printf("Parse Error: Unexpected syntax encountered.\n");
 					debug_printf("%s\n", "parse: Exited");
-					free(token);
 					freeCmdTable(cmdTab);
-					return;
+					return false;
 				}
 				else if(IS_NORMAL(c)) {
-					token[tokenIdx++] = c;
+					token = &line[i];
 					currentState = FILENAME;
 				}
 				else if(IS_NULL(c)) {
 					printf("Parse Error: Unexpected syntax encountered.\n");
 					debug_printf("%s\n", "parse: Exited");
-					free(token);
 					freeCmdTable(cmdTab);
-					return;
+					return false;
 				}
 				else if(IS_AMPERSAND(c)) {
 					cmdTab->isbackground = true;
@@ -215,8 +552,7 @@ void parse(char *cmdLine, cmdTable *cmdTab) {
 				if(IS_NULL(c)) {
 					argsRow++;
 					cmdTab->numCmds = argsRow;
-					free(token);
-					return;
+					return checkCmds(cmdTab);
 				}
 				else if (IS_WHITESPACE(c)) {
 					;
@@ -224,30 +560,41 @@ void parse(char *cmdLine, cmdTable *cmdTab) {
 				else {
 					printf("Parse Error: Unexpected Syntax Error encountered\n");
 					debug_printf("%s\n", "parse: Exited");
-					free(token);
 					freeCmdTable(cmdTab);
-					return;
+					return false;
 				}
 				break;
 
 			case FILENAME:
 				if(IS_NORMAL(c)) {
-					token[tokenIdx++] = c;
+					;
 				}
 				else {
 					if(argExpected == INFILE) {
-						token[tokenIdx] = '\0';
+						line[i] = '\0';
 						debug_printf("parse: infile <%s> formed\n", token);
-						free(cmdTab->infile);
-						cmdTab->infile = strdup(token);
-						tokenIdx = 0;
+						cmdTab->infile = token;
+						cmdTab->heredoc = cmdTab->heredocEnd = NULL;
+					}
+					else if(argExpected == HEREDOC) {
+						line[i] = '\0';
+						debug_printf("parse: here-document end <%s> formed\n", token);
+						cmdTab->heredocEnd = token;
+						cmdTab->heredoc = cmdTab->infile = NULL;
+						cmdTab->heredocLen = 0;
+					}
+					else if(argExpected == HERESTRING) {
+						line[i] = '\0';
+						debug_printf("parse: here-string <%s> formed\n", token);
+						cmdTab->heredocLen = &line[i] - token + 1;
+						cmdTab->heredoc = memcpy(arenaAlloc(&cmdTab->mem, cmdTab->heredocLen), token, cmdTab->heredocLen);
+						cmdTab->heredoc[cmdTab->heredocLen - 1] = '\n';
+						cmdTab->heredocEnd = cmdTab->infile = NULL;
 					}
 					else if(argExpected == OUTFILE) {
-						token[tokenIdx] = '\0';
+						line[i] = '\0';
 						debug_printf("parse: outfile <%s> formed\n", token);
-						free(cmdTab->outfile);
-						cmdTab->outfile = strdup(token);
-						tokenIdx = 0;
+						cmdTab->outfile = token;
 					}
 					
 					argExpected = COMMAND;
@@ -275,9 +622,8 @@ void parse(char *cmdLine, cmdTable *cmdTab) {
 					else if(IS_NULL(c)) {
 						argsRow++;
 						cmdTab->numCmds = argsRow;
-						free(token);
 						debug_printf("%s\n", "parse: Exited");
-						return;
+						return checkCmds(cmdTab);
 					}
 				}
 				break;
@@ -286,6 +632,224 @@ void parse(char *cmdLine, cmdTable *cmdTab) {
 	}
 
 	debug_printf("%s\n", "parse: Exited");
+	return false;
+}
+
+/**
+ * @brief Finds the next list operator, a single | being part of a pipeline
+ * 
+ * @param c Pointer into the line
+ * @return Pointer to the next ;, &, && or ||, or to the end of the first line
+ */
+static char *nextOperator(char *c) {
+	char *end;
+
+	while(*c && *c != '\n' && *c != ';' && *c != '&' && !(c[0] == '|' && c[1] == '|')) {
+		/* Operators inside a process substitution are its own */
+		if(IS_SUBST(c) && (end = closeParen(c + 1)))
+			c = end;
+		c++;
+	}
+	return c;
+}
+
+/**
+ * @brief Drop a reference to a command list, freeing it and releasing its
+ * command tables with the last one
+ * 
+ * @param list Pointer to command list
+ */
+void releaseCmdList(cmdList *list) {
+	if(--list->refs > 0)
+		return;
+	for(int i = 0; i < list->numSteps; i++)
+		releaseCmdTable(list->steps[i].cmdTab);
+	free(list->steps);
+	free(list->cmdLine);
+	free(list);
+}
+
+/**
+ * @brief Take a reference to a command list
+ * 
+ * @param list Pointer to command list
+ * @return list
+ */
+cmdList *holdCmdList(cmdList *list) {
+	list->refs++;
+	return list;
+}
+
+/**
+ * @brief Find the next here-document of a line
+ * 
+ * Here-strings and process substitutions are skipped.
+ * 
+ * @param c Pointer into the first line
+ * @param len Set to the length of the word ending it
+ * @return Pointer to the word after the next <<, NULL if there is none
+ */
+char *findHeredoc(char *c, size_t *len) {
+	char *end;
+
+	for(; *c && *c != '\n'; c++) {
+		if(IS_SUBST(c) && (end = closeParen(c + 1))) {
+			c = end;
+		}
+		else if(c[0] == '<' && c[1] == '<' && c[2] == '<') {
+			c += 2;
+		}
+		else if(c[0] == '<' && c[1] == '<') {
+			c += 2 + strspn(c + 2, " ");
+			for(*len = 0; IS_NORMAL(c[*len]) && c[*len] != ';'; (*len)++)
+				;
+			if(*len)
+				return c;
+			c--;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Takes the body of the here-document of a command table off the
+ * lines after the first one
+ * 
+ * The body is every line up to the one that is the word given after <<,
+ * or up to the end if that line is missing. It is copied into the arena
+ * of the table, so a cached line keeps it.
+ * 
+ * @param cmdTab Pointer to command table
+ * @param body Pointer to the lines left, advanced past the body
+ */
+static void takeHeredoc(cmdTable *cmdTab, char **body) {
+	size_t endLen, lineLen;
+	char *c = *body, *next;
+
+	if(cmdTab->heredocEnd == NULL || c == NULL)
+		return;
+
+	endLen = strlen(cmdTab->heredocEnd);
+	while(*c) {
+		next = strchr(c, '\n');
+		lineLen = next ? (size_t)(next - c) : strlen(c);
+		if(lineLen == endLen && strncmp(c, cmdTab->heredocEnd, endLen) == 0)
+			break;
+		c += next ? lineLen + 1 : lineLen;
+	}
+
+	cmdTab->heredocLen = c - *body;
+	cmdTab->heredoc = memcpy(arenaAlloc(&cmdTab->mem, cmdTab->heredocLen + 2), *body, cmdTab->heredocLen);
+	/* The last line ends with a newline even if the input did not */
+	if(cmdTab->heredocLen && cmdTab->heredoc[cmdTab->heredocLen - 1] != '\n')
+		cmdTab->heredoc[cmdTab->heredocLen++] = '\n';
+	cmdTab->heredoc[cmdTab->heredocLen] = '\0';
+	if(*c) {
+		next = strchr(c, '\n');
+		c = next ? next + 1 : c + endLen;
+	}
+	*body = c;
+}
+
+/**
+ * @brief Parse a command line of pipelines separated by ;, &, && and ||
+ * 
+ * The line is cut at every list operator in one pass and each pipeline is
+ * parsed on its own by parse(). An & after a single pipeline stays with it,
+ * so it becomes a background job as before; an & after several pipelines
+ * joined by && or || is recorded on the first of them. A ; or & may end the
+ * line. Lines after the first one hold the bodies of its here-documents,
+ * in order.
+ * 
+ * @param cmdLine Pointer to line to be parsed
+ * @return Pointer to command list with one reference, NULL on a syntax error
+ */
+cmdList *parseList(char *cmdLine) {
+	size_t len = strlen(cmdLine), segLen;
+	int maxSteps = 4, groupStart = 0;
+	ListOp op = LIST_SEQ;
+	char *start = cmdLine, *end, *seg, *body = strchr(cmdLine, '\n');
+	cmdList *list = calloc(1, sizeof(cmdList));
+	cmdTable *cmdTab;
+
+	seg = malloc(len + 1);
+	if(list == NULL || seg == NULL || (list->steps = malloc(maxSteps * sizeof(listStep))) == NULL ||
+	   (list->cmdLine = strdup(cmdLine)) == NULL) {
+		perror("parse");
+		exit(EXIT_FAILURE);
+	}
+	list->refs = 1;
+	if(body)
+		body++;
+
+	while(1) {
+		end = nextOperator(start);
+
+		/* Pipeline without the blanks around it, with a lone & kept */
+		start += strspn(start, " ");
+		segLen = end - start;
+		while(segLen > 0 && IS_WHITESPACE(start[segLen - 1]))
+			segLen--;
+		if(segLen == 0) {
+			/* Only the end of the line may follow a ; or & */
+			if((*end == '\0' || *end == '\n') && op == LIST_SEQ && list->numSteps > 0)
+				break;
+			printf("Parse Error: Unexpected syntax encountered.\n");
+			free(seg);
+			releaseCmdList(list);
+			return NULL;
+		}
+		memcpy(seg, start, segLen);
+		if(end[0] == '&' && end[1] != '&' && groupStart == list->numSteps) {
+			seg[segLen++] = ' ';
+			seg[segLen++] = '&';
+		}
+		seg[segLen] = '\0';
+
+		if((cmdTab = malloc(sizeof(cmdTable))) == NULL) {
+			perror("parse");
+			exit(EXIT_FAILURE);
+		}
+		initCmdTable(cmdTab);
+		if(!parse(seg, cmdTab)) {
+			free(cmdTab);
+			free(seg);
+			releaseCmdList(list);
+			return NULL;
+		}
+		takeHeredoc(cmdTab, &body);
+
+		if(list->numSteps == maxSteps) {
+			maxSteps *= 2;
+			if((list->steps = realloc(list->steps, maxSteps * sizeof(listStep))) == NULL) {
+				perror("parse");
+				exit(EXIT_FAILURE);
+			}
+		}
+		list->steps[list->numSteps++] = (listStep){ cmdTab, op, 0 };
+
+		/* Operator after the pipeline */
+		if(*end == '\0' || *end == '\n')
+			break;
+		if(end[0] == '&' && end[1] == '&') {
+			op = LIST_AND;
+			start = end + 2;
+		}
+		else if(end[0] == '|') {
+			op = LIST_OR;
+			start = end + 2;
+		}
+		else {
+			if(*end == '&' && list->numSteps - groupStart > 1)
+				list->steps[groupStart].background = list->numSteps - groupStart;
+			op = LIST_SEQ;
+			groupStart = list->numSteps;
+			start = end + 1;
+		}
+	}
+
+	free(seg);
+	return list;
 }
 
 /**
@@ -1,5 +1,8 @@
-#define ARGS_SIZE 1024
-#define MAX_CMDS 32
+/* Size of the first block of a command line arena */
+#define ARENA_BLOCK_SIZE 1024
+
+/* Round size up so that arena allocations stay aligned for pointers */
+#define ARENA_ALIGN(size) (((size) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
 
 /* For debugging purposes */
 #define DEBUG 0
@@ -16,19 +19,104 @@
 #define IS_NORMAL(c) 		((!IS_NULL(c)) && (!IS_INPUT(c)) && (!IS_OUTPUT(c)) && \
 							(!IS_WHITESPACE(c)) && (!IS_PIPE(c)) && (!IS_AMPERSAND(c)))
 
+/* To check if a string starts with a process substitution, <( or >( */
+#define IS_SUBST(s) 		((IS_INPUT((s)[0]) || IS_OUTPUT((s)[0])) && (s)[1] == '(')
+
 /**
- * Command table to store all information regarding commands,
- * their redirection files, and if background or not
+ * Block of memory owned by an arena. Blocks are chained so that everything
+ * allocated for a command line is released in one go.
+ */
+typedef struct arenaBlock {
+	struct arenaBlock *next;
+	size_t size;
+	size_t used;
+	char data[];
+} arenaBlock;
+
+/* Bump allocator holding all memory of a single command line */
+typedef struct {
+	arenaBlock *head;
+} arena;
+
+/**
+ * Process substitution <(cmd) or >(cmd) in an argument. The executor starts
+ * its pipeline connected to a pipe and passes /dev/fd/N in place of the
+ * argument, which keeps the text of the substitution.
  */
 typedef struct {
+	/* Command and argument it appears in */
+	int cmd;
+	int arg;
+	/* Whether it is >(cmd), whose pipeline reads what the command writes */
+	bool output;
+	/* Pipeline inside the parentheses, in the arena of the outer table */
+	struct cmdTable *cmdTab;
+} procSubst;
+
+/**
+ * Command table to store all information regarding commands,
+ * their redirection files, and if background or not.
+ * Everything it points to lives in its arena: arguments and file names
+ * are spans of a private copy of the line, terminated in place.
+ */
+typedef struct cmdTable {
+	arena mem;
 	char *cmdLine;
-	char *args[MAX_CMDS][ARGS_SIZE];
+	/* NULL terminated argument vector of each command, sized to fit */
+	char ***args;
 	char *infile;
 	char *outfile;
+	/* Standard input of the first command given in the line, with <<END or
+	   <<<word, NULL if none */
+	char *heredoc;
+	size_t heredocLen;
+	/* Line ending a here-document, NULL for a here-string */
+	char *heredocEnd;
 	bool isbackground;
+	/* Line started with the time prefix, which is not in args */
+	bool timed;
+	/* Some argument has * or ? to expand into the files it matches */
+	bool globs;
+	/* CPUs and priorities given with the sched prefix, NULL if none */
+	struct schedSpec *sched;
+	/* Process substitutions in the arguments, in the order they appear */
+	procSubst *substs;
+	int numSubsts;
 	int numCmds;
+	/* References held by the parse cache, jobs and the executor */
+	int refs;
 } cmdTable;
 
+/* How a pipeline of a list runs after the previous one: always, only if
+   it succeeded, or only if it failed */
+typedef enum {
+	LIST_SEQ, LIST_AND, LIST_OR
+} ListOp;
+
+/* Pipeline of a command list with the operator before it */
+typedef struct {
+	cmdTable *cmdTab;
+	ListOp op;
+	/* On the first pipeline of an and-or list of several pipelines ended
+	   by &, number of pipelines in it, which run in background together;
+	   0 otherwise */
+	int background;
+} listStep;
+
+/**
+ * Command line compiled to a flat array of pipelines separated by ;, &,
+ * && and ||, which the executor walks once from start to end. Like the
+ * command tables in it, it is not changed after parsing.
+ */
+typedef struct {
+	/* Line as given, owned by the list */
+	char *cmdLine;
+	listStep *steps;
+	int numSteps;
+	/* References held by the parse cache and the main loop */
+	int refs;
+} cmdList;
+
 /* States of finite state machine to parse command */
 typedef enum {
 	INIT, ARGS, CMD, SPECIAL, AMPERSAND, FILENAME
@@ -36,13 +124,33 @@ typedef enum {
 
 /* Types of arguments in any command */
 typedef enum {
-	COMMAND, INFILE, OUTFILE
+	COMMAND, INFILE, OUTFILE, HEREDOC, HERESTRING
 } ArgType;
 
+void arenaReserve(arena *mem, size_t size);
+
+void *arenaAlloc(arena *mem, size_t size);
+
+char *arenaStrdup(arena *mem, const char *str);
+
+void arenaFree(arena *mem);
+
 void initCmdTable(cmdTable *cmdTab);
 
 void freeCmdTable(cmdTable *cmdTab);
 
-void parse(char *cmdLine, cmdTable *cmdTab);
+cmdTable *holdCmdTable(cmdTable *cmdTab);
+
+void releaseCmdTable(cmdTable *cmdTab);
+
+bool parse(char *cmdLine, cmdTable *cmdTab);
+
+cmdList *parseList(char *cmdLine);
+
+char *findHeredoc(char *c, size_t *len);
+
+cmdList *holdCmdList(cmdList *list);
+
+void releaseCmdList(cmdList *list);
 
 void printCmdTable(cmdTable *cmdTab);
\ No newline at end of file
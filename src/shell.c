@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -7,70 +8,114 @@
 #include <errno.h>
 #include <limits.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <pwd.h>
+#include <spawn.h>
+#include <signal.h>
 #include "shell.h"
+#include "hash.h"
+#include "input.h"
+#include "events.h"
+#include "parallel.h"
+#include "builtins.h"
+#include "stream.h"
+#include "history.h"
+#include "cache.h"
+#include "launcher.h"
+#include "jobsched.h"
+#include "trace.h"
+#include "stats.h"
+#include "wildcard.h"
+
+/* Whether the shell reads from a terminal and does job control */
+bool interactive = true;
+
+/* Exit status of the last foreground job or builtin */
+int lastStatus = 0;
+
+/* Launch backend used by executor */
+LaunchMode launchMode = LAUNCH_SPAWN;
+
+/* Set by the exit builtin, the shell exits after the current command line */
+bool exitRequested = false;
+
+/* Prompt as written to the terminal, and the parts of it that never change */
+static char prompt[PROMPT_SIZE];
+static size_t promptLen = 0;
+static char promptUser[LOGIN_NAME_MAX + 1] = "?";
+static char promptHost[HOST_NAME_MAX + 1] = "?";
 
 /**
- * @brief Prints a pretty prompt 
+ * @brief Resolves user and host name for the prompt
+ * 
+ * Done once at startup, as getpwuid may have to ask a name service.
  * 
- * Prints a pretty prompt consisting of username, hostname and 
- * current working directory
  */
-void printPrompt() {
-	char cwd[PATH_MAX];
-	if(getcwd(cwd, sizeof(cwd)) == NULL) {
-		perror("getcwd");
-		exit(EXIT_FAILURE);
-	}
-	
-	char hostname[HOST_NAME_MAX + 1];
-	gethostname(hostname, HOST_NAME_MAX + 1);
-	
+void initPrompt() {
 	struct passwd *pw = getpwuid(geteuid());
 	if(pw == NULL) {
 		perror("getpwuid");
 	}
+	else {
+		snprintf(promptUser, sizeof(promptUser), "%s", pw->pw_name);
+	}
 
-	printf("╭─");
-	printf(CYN "%s@%s " RESET, pw->pw_name, hostname);
-	printf(BLU "[%s]\n" RESET, cwd);
-	printf("╰─");
-	printf(GRN "$ " RESET);
-	
-	return;
+	if(gethostname(promptHost, sizeof(promptHost)) == -1) {
+		perror("gethostname");
+	}
+	promptHost[HOST_NAME_MAX] = '\0';
+
+	updatePrompt();
 }
 
 /**
- * @brief Handler for SIGCHLD
+ * @brief Renders the prompt again for a new working directory
  * 
- * Handles the termination of child processes by updating status in jobs table
+ * Called at startup and by cd, which is the only way the shell changes
+ * its directory. The old directory is kept if the new one has no name.
  * 
- * @param signum Integer
  */
-void sigchldHandler(int signum) {
-	int status;
-	pid_t temppid = waitpid(-1, &status, WNOHANG);
-	if (temppid <= 0)
-		return;
-
-	if(WIFEXITED(status)) {
-		for(int i = 0; i < jobsTableIdx; i++) {
-			for(int j = 0; j < MAX_PROCS_IN_GROUP; j++) {
-				if(temppid == jobsTable[i].pids[j]) {
-					jobsTable[i].numProcs--;
-					break;
-				}
-			}
+void updatePrompt() {
+	char cwd[PATH_MAX];
+	int len;
 
-			if(jobsTable[i].numProcs == 0) {
-				printf("Done\t\tPGID [%d]\t\t\"%s\"\n", jobsTable[i].pgid, jobsTable[i].cmdTab.cmdLine);
-				for(int j = i + 1; j < jobsTableIdx; j++) {
-					jobsTable[j - 1] = jobsTable[j];
-				}
-				jobsTableIdx--;
-			}
-		}
+	if(getcwd(cwd, sizeof(cwd)) == NULL) {
+		perror("getcwd");
+		if(promptLen)
+			return;
+		strcpy(cwd, "?");
 	}
+
+	len = snprintf(prompt, sizeof(prompt), "╭─" CYN "%s@%s " RESET BLU "[%s]\n" RESET "╰─" GRN "$ " RESET,
+		promptUser, promptHost, cwd);
+	promptLen = len < (int)sizeof(prompt) ? len : sizeof(prompt) - 1;
+}
+
+/**
+ * @brief Prints a pretty prompt 
+ * 
+ * Writes the prompt consisting of username, hostname and current working
+ * directory, rendered beforehand, with a single write. Safe to call from
+ * a signal handler. Anything printed with stdio must be flushed first.
+ */
+void printPrompt() {
+	ssize_t written = write(STDOUT_FILENO, prompt, promptLen);
+	(void)written;
+}
+
+/**
+ * @brief Prints the prompt from the main loop, timing it
+ * 
+ * The handlers of SIGINT and SIGTSTP call printPrompt directly, as the
+ * histograms could be in the middle of an update when they run.
+ */
+static void showPrompt() {
+	long long started;
+
+	fflush(stdout);
+	started = statsNow();
+	printPrompt();
+	recordLatency(STAT_PROMPT, started);
 }
 
 /**
@@ -81,9 +126,9 @@ void sigchldHandler(int signum) {
  * @param signum Integer
  */
 void sigintHandler(int signum) {
-	printf("\n");
+	ssize_t written = write(STDOUT_FILENO, "\n", 1);
+	(void)written;
 	printPrompt();
-    fflush(stdout);
 }
 
 /**
@@ -94,247 +139,726 @@ void sigintHandler(int signum) {
  * @param signum Integer
  */
 void sigtstpHandler(int signum) {
-	printf("\n");
+	ssize_t written = write(STDOUT_FILENO, "\n", 1);
+	(void)written;
 	printPrompt();
-    fflush(stdout);
 }
 
 /**
- * @brief Prints jobs table
+ * @brief Starts a process with fork and exec
  * 
+ * The child resets job control signals, joins the process group, takes
+ * the CPUs and priorities of its stage and connects its standard input
+ * and output before executing argv, or running a builtin as the stage of
+ * a pipeline.
+ * 
+ * @param file File to execute, searched in PATH if it has no slash
+ * @param argv NULL terminated argument vector
+ * @param pgid Process group to join, 0 to lead a new one
+ * @param foreground Whether the job gets the terminal
+ * @param infd Descriptor to use as standard input
+ * @param outfd Descriptor to use as standard output
+ * @param mask Signal mask for the new process
+ * @param b Builtin to run instead of executing file, NULL for none
+ * @param cmdTab Command table the process is part of, NULL for none
+ * @param stage Index of the command in cmdTab
+ * @return pid of the new process, -1 if it could not be started
  */
-void printJobsTable() {
-	if(jobsTableIdx == 0) {
-		printf("No background or stopped jobs\n");
-		return;
+static pid_t forkProcess(char *file, char **argv, pid_t pgid, bool foreground, int infd, int outfd,
+		sigset_t *mask, const builtin *b, cmdTable *cmdTab, int stage) {
+	pid_t pid;
+
+	/* Output buffered so far must not be written by the child too */
+	fflush(stdout);
+	pid = fork();
+
+	if(pid == -1) {
+		/* Fork failed */
+		perror("fork");
+		return -1;
+	}
+	else if(pid > 0) {
+		return pid;
 	}
 
-	printf(" PGID \t  Status \tCommand\n");
-	for(int i = 0; i < jobsTableIdx; i++) {
-		switch(jobsTable[i].status) {
-		case FG:
-			printf("[%d]\t  Foreground\t%s\n", jobsTable[i].pgid, jobsTable[i].cmdTab.cmdLine);
-			break;
-		case BG:
-			printf("[%d]\t  Running\t%s\n", jobsTable[i].pgid, jobsTable[i].cmdTab.cmdLine);
-			break;
-		case STOPPED:
-			printf("[%d]\t  Stopped\t%s\n", jobsTable[i].pgid, jobsTable[i].cmdTab.cmdLine);
-			break;
+	/* The trace and its buffer stay with the shell */
+	dropTrace();
+
+	/* Setting same group pid for entire process group, and taking the
+	   terminal before the shell gets to, in case the process reads first */
+	if(interactive) {
+		setpgid(0, pgid);
+		if(foreground) {
+			signal(SIGTTOU, SIG_IGN);
+			tcsetpgrp(STDIN_FILENO, getpgrp());
 		}
 	}
+
+	/* Child process, restore default signal handlers */
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+	signal(SIGTTIN, SIG_DFL);
+	signal(SIGTTOU, SIG_DFL);
+	sigprocmask(SIG_SETMASK, mask, NULL);
+
+	if(cmdTab && cmdTab->sched && applySched(0, cmdTab->sched, stage) == -1) {
+		perror("sched");
+		_exit(EXIT_FAILURE);
+	}
+
+	if(infd != STDIN_FILENO && dup2(infd, STDIN_FILENO) < 0) {
+		perror("dup2 input");
+		_exit(EXIT_FAILURE);
+	}
+	if(outfd != STDOUT_FILENO && dup2(outfd, STDOUT_FILENO) < 0) {
+		perror("dup2 output");
+		_exit(EXIT_FAILURE);
+	}
+
+	/* A builtin in a child has no job control, like one in a subshell */
+	if(b) {
+		interactive = false;
+		/* Its own children must not wake the event loop of the shell */
+		initEvents();
+		dropLauncher();
+		int status = b->func(argv, cmdTab);
+		fflush(stdout);
+		_exit(status);
+	}
+
+	/* Every other descriptor of the job is close-on-exec */
+	execvp(file, argv);
+	perror(argv[0]);
+	_exit(127);
 }
 
 /**
- * @brief Makes a job out of a command table
+ * @brief Starts a process with posix_spawn
  * 
- * @param cmdTab Pointer to command table
- * @return job
+ * Does the same setup as forkProcess through spawn attributes and file
+ * actions, so that the C library can start the process without copying
+ * the page tables of the shell (vfork-style clone on Linux).
+ * 
+ * @param file File to execute, searched in PATH if it has no slash
+ * @param argv NULL terminated argument vector
+ * @param pgid Process group to join, 0 to lead a new one
+ * @param infd Descriptor to use as standard input
+ * @param outfd Descriptor to use as standard output
+ * @param mask Signal mask for the new process
+ * @return pid of the new process, -1 if it could not be started
  */
-job makeJob(cmdTable *cmdTab) {
-	job temp;
-	temp.cmdTab = *cmdTab;
-	temp.pgid = 0;
-	for(int i = 0; i < MAX_PROCS_IN_GROUP; i++)
-		temp.pids[i] = 0;
-	temp.numProcs = 0;
-	return temp;
+static pid_t spawnProcess(char *file, char **argv, pid_t pgid, int infd, int outfd, sigset_t *mask) {
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	sigset_t defaults;
+	pid_t pid;
+	int err;
+
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGINT);
+	sigaddset(&defaults, SIGTSTP);
+	sigaddset(&defaults, SIGQUIT);
+	sigaddset(&defaults, SIGCHLD);
+	sigaddset(&defaults, SIGTTIN);
+	sigaddset(&defaults, SIGTTOU);
+
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, (interactive ? POSIX_SPAWN_SETPGROUP : 0) |
+		POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
+	posix_spawnattr_setpgroup(&attr, pgid);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	posix_spawnattr_setsigmask(&attr, mask);
+
+	posix_spawn_file_actions_init(&actions);
+	if(infd != STDIN_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, infd, STDIN_FILENO);
+	if(outfd != STDOUT_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, outfd, STDOUT_FILENO);
+
+	err = posix_spawnp(&pid, file, &actions, &attr, argv, environ);
+
+	posix_spawn_file_actions_destroy(&actions);
+	posix_spawnattr_destroy(&attr);
+
+	if(err != 0) {
+		errno = err;
+		perror(argv[0]);
+		return -1;
+	}
+	return pid;
 }
 
 /**
- * @brief Executes the job
+ * @brief Starts one process of a job using the selected launch mode
  * 
- * Given a command table, makes a job out of it and then executes it using
- * fork exec semantics after doing needed redirection / piping.
- * It waits job was a foreground process.
+ * @param file File to execute, searched in PATH if it has no slash
+ * @param argv NULL terminated argument vector
+ * @param pgid Process group to join, 0 to lead a new one
+ * @param foreground Whether the job gets the terminal
+ * @param infd Descriptor to use as standard input
+ * @param outfd Descriptor to use as standard output
+ * @param mask Signal mask for the new process
+ * @return pid of the new process, -1 if it could not be started
+ */
+pid_t launchProcess(char *file, char **argv, pid_t pgid, bool foreground, int infd, int outfd, sigset_t *mask) {
+	if(launchMode == LAUNCH_FORK)
+		return forkProcess(file, argv, pgid, foreground, infd, outfd, mask, NULL, NULL, 0);
+	if(launchMode == LAUNCH_HELPER)
+		return launcherSpawn(file, argv, pgid, foreground, infd, outfd, mask);
+	return spawnProcess(file, argv, pgid, infd, outfd, mask);
+}
+
+static pid_t launchStages(job *newJob, cmdTable *cmdTab, int infd, int lastfd, pid_t pgid,
+		bool foreground, sigset_t *mask, bool owner);
+
+/**
+ * @brief Puts the here-document or here-string of a command table in a
+ * file to be the standard input of its first command
+ * 
+ * The file is made with memfd_create, so the data lives in memory only
+ * and no process has to write it to a pipe while the command runs.
  * 
  * @param cmdTab Pointer to command table
+ * @return Descriptor of the file at its start, -1 on failure with errno set
  */
-void executor(cmdTable *cmdTab) {
-	pid_t pid, pgid, tmp;
-	int infd, outfd, status;
-	int numPipes = cmdTab->numCmds - 1;
-	int pfd[2 * cmdTab->numCmds + 1];
-	job temp = makeJob(cmdTab);
+int openHeredoc(cmdTable *cmdTab) {
+	size_t done = 0;
+	ssize_t n;
+	int fd;
 
-	/* Make all the pipes needed for the commands */
-	for(int i = 0; i < cmdTab->numCmds; i++) {
-		if(pipe(pfd + i*2) < 0) {
-			perror("pipe :");
-			exit(EXIT_FAILURE);
+	if((fd = memfd_create("heredoc", MFD_CLOEXEC)) == -1)
+		return -1;
+	while(done < cmdTab->heredocLen) {
+		if((n = write(fd, cmdTab->heredoc + done, cmdTab->heredocLen - done)) == -1) {
+			if(errno == EINTR)
+				continue;
+			close(fd);
+			return -1;
 		}
+		done += n;
+	}
+	if(lseek(fd, 0, SEEK_SET) == -1) {
+		close(fd);
+		return -1;
 	}
+	return fd;
+}
 
-	for(int i = 0; i < cmdTab->numCmds; i++) {
-		/* Set signal handlers for parent */
-		signal(SIGINT, SIG_IGN);
-		signal(SIGTSTP, SIG_IGN);
-		signal(SIGTTOU, SIG_IGN);
-		signal(SIGCHLD, sigchldHandler);
+/**
+ * @brief Starts the pipelines of the process substitutions of a command
+ * 
+ * Each one runs as part of the job, connected to a pipe. The command gets
+ * the other end as an argument naming it in /dev/fd, which it inherits
+ * across exec: the caller closes it in the shell once the command started.
+ * Ends are only made inheritable once every pipeline of the command has
+ * started, so that none of them holds the pipe of another one open.
+ * 
+ * @param newJob Pointer to job
+ * @param cmdTab Pointer to command table
+ * @param stage Index of the command
+ * @param pgid Process group to join, 0 to lead a new one, set to that of
+ * the job
+ * @param foreground Whether the job gets the terminal
+ * @param mask Signal mask for the new processes
+ * @param fds Set to the ends kept for the command, one per substitution
+ * @return Argument vector of the command with the paths in place of its
+ * substitutions, to be freed by the caller, NULL if it has none
+ */
+static char **startSubsts(job *newJob, cmdTable *cmdTab, int stage, pid_t *pgid, bool foreground,
+		sigset_t *mask, int *fds) {
+	int argc = 0, numSubsts = 0, pfd[2], infd, outfd;
+	procSubst *subst;
+	cmdTable *inner;
+	char **argv, *path;
+
+	for(int k = 0; k < cmdTab->numSubsts; k++)
+		if(cmdTab->substs[k].cmd == stage)
+			numSubsts++;
+	if(numSubsts == 0)
+		return NULL;
+
+	/* Argument vector and paths in one block */
+	while(cmdTab->args[stage][argc])
+		argc++;
+	if((argv = malloc((argc + 1) * sizeof(char *) + numSubsts * sizeof("/dev/fd/2147483647"))) == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(argv, cmdTab->args[stage], (argc + 1) * sizeof(char *));
+	path = (char *)(argv + argc + 1);
 
-		if((pid = fork()) == -1) {
-			/* Fork failed */
-			perror("fork: ");
+	for(int k = 0; k < cmdTab->numSubsts; k++) {
+		subst = &cmdTab->substs[k];
+		if(subst->cmd != stage)
+			continue;
+		if(pipe2(pfd, O_CLOEXEC) < 0) {
+			perror("pipe");
 			exit(EXIT_FAILURE);
 		}
-		else if(pid == 0) {
-			/* Child process */
-
-			/* Restore default signal handlers */
-			signal(SIGINT, SIG_DFL);
-			signal(SIGTSTP, SIG_DFL);
-			signal(SIGQUIT, SIG_DFL);
-			signal(SIGCHLD, SIG_DFL);
-			signal(SIGTTIN, SIG_DFL);
-			signal(SIGTTOU, SIG_DFL);
-
-			/* Setting same group pid for entire process group */
-			if(i == 0) {
-				pgid = getpid();
-			}
-			setpgid(0, pgid);
-			temp.pids[i] = pid;
-			temp.numProcs++;
-
-			/* Set input file if first process */
-			if(i == 0 && cmdTab->infile) {
-				infd = open(cmdTab->infile, READ_FLAGS, READ_MODES);
-				if(infd == -1) {
-					perror("input file :");
-					exit(EXIT_FAILURE);
-				}
-				dup2(infd, 0);
-				close(infd);
-			}
+		sizePipe(pfd[1]);
+		inner = subst->cmdTab;
+		infd = subst->output ? pfd[0] : STDIN_FILENO;
+		outfd = subst->output ? STDOUT_FILENO : pfd[1];
+		fds[k] = subst->output ? pfd[1] : pfd[0];
 
-			/* Set output file if last process */
-			if(i == numPipes && cmdTab->outfile) {
-				outfd = open(cmdTab->outfile, CREATE_FLAGS, CREATE_MODES);
-				if(outfd == -1) {
-					perror("output file :");
-					exit(EXIT_FAILURE);
-				}
-				dup2(outfd, 1);
-				close(outfd);
-			}
+		/* Without its redirection files the pipeline is not started, and
+		   the command sees an empty pipe */
+		if(inner->heredoc && (infd = openHeredoc(inner)) == -1)
+			perror("heredoc");
+		else if(!inner->heredoc && inner->infile && (infd = open(inner->infile, READ_FLAGS | O_CLOEXEC, READ_MODES)) == -1)
+			perror(inner->infile);
+		else if(inner->outfile && (outfd = open(inner->outfile, CREATE_FLAGS | O_CLOEXEC, CREATE_MODES)) == -1)
+			perror(inner->outfile);
+		else
+			*pgid = launchStages(newJob, inner, infd, outfd, *pgid, foreground, mask, false);
 
-			/* Child gets input from previous process if it's not first process */
-			if(i != 0) {
-				if(dup2(pfd[2*i - 2], 0) < 0) {
-					perror("pipe input: ");
-					exit(EXIT_FAILURE);
-				}
-			}
+		if(infd != STDIN_FILENO && infd != -1)
+			close(infd);
+		if(outfd != STDOUT_FILENO && outfd != -1)
+			close(outfd);
+		if(subst->output ? infd != pfd[0] : outfd != pfd[1])
+			close(subst->output ? pfd[0] : pfd[1]);
+	}
 
-			/* Child outputs to next process if it's not last process */
-			if(i != numPipes) {
-				if(dup2(pfd[(2*i + 1)], 1) < 0) {
-					perror("pipe output: ");
-					exit(EXIT_FAILURE);
-				}
-			}
+	for(int k = 0; k < cmdTab->numSubsts; k++) {
+		subst = &cmdTab->substs[k];
+		if(subst->cmd != stage)
+			continue;
+		fcntl(fds[k], F_SETFD, 0);
+		argv[subst->arg] = path;
+		path += sprintf(path, "/dev/fd/%d", fds[k]) + 1;
+	}
+	return argv;
+}
 
-			/* Close all pfds */
-			for(int j = 0; j < (2 * numPipes); j++) {
-				close(pfd[j]);
-			}
+/**
+ * @brief Starts the processes of a pipeline as part of a job
+ * 
+ * The pipelines of process substitutions in its arguments are started
+ * first, into the same job and process group.
+ * 
+ * @param newJob Pointer to job
+ * @param cmdTab Pointer to command table of pipeline
+ * @param infd Standard input of the first process, left open
+ * @param lastfd Standard output of the last process, left open
+ * @param pgid Process group to join, 0 to lead a new one
+ * @param foreground Whether the job gets the terminal
+ * @param mask Signal mask for the new processes
+ * @param owner Whether the pipeline is that of the job, whose last process
+ * gives the job its status
+ * @return Process group of the job, 0 if no process was started yet
+ */
+static pid_t launchStages(job *newJob, cmdTable *cmdTab, int infd, int lastfd, pid_t pgid,
+		bool foreground, sigset_t *mask, bool owner) {
+	pid_t pid;
+	int readfd = infd, outfd;
+	int pfd[2] = { STDIN_FILENO, STDOUT_FILENO };
+	int numPipes = cmdTab->numCmds - 1;
+	int *substFds = NULL;
+	arena globMem = { NULL };
+	const builtin *b;
+	char **argv, **substArgv;
+	long long started, launched;
 
-			/* Execute the process finally */
-			if((execvp(cmdTab->args[i][0], cmdTab->args[i])) == -1) {
-				perror(cmdTab->args[i][0]);
-				freeCmdTable(cmdTab);
+	if(cmdTab->numSubsts && (substFds = malloc(cmdTab->numSubsts * sizeof(int))) == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for(int i = 0; i < cmdTab->numCmds; i++) {
+		/* Every process but the last one outputs to a new pipe */
+		if(i != numPipes) {
+			if(pipe2(pfd, O_CLOEXEC) < 0) {
+				perror("pipe");
 				exit(EXIT_FAILURE);
 			}
+			sizePipe(pfd[1]);
+			outfd = pfd[1];
 		}
 		else {
-			/* Parent process */
-			close(pfd[2*i + 1]);
-			close(pfd[2*i - 2]);
+			outfd = lastfd;
+		}
 
-			/* Set pgid's of all processes to pid of first process in job */
-			if(i == 0) {
-				pgid = pid;
-			}
+		substArgv = cmdTab->numSubsts ? startSubsts(newJob, cmdTab, i, &pgid, foreground, mask, substFds) : NULL;
+		argv = substArgv ? substArgv : cmdTab->args[i];
+		if(cmdTab->globs)
+			argv = expandWildcards(argv, &globMem);
+
+		/* A builtin that is part of a pipeline runs in a child of its own,
+		   and only a forked child can take settings before it executes or
+		   inherit the pipes of its substitutions, which the launcher lacks */
+		started = traceNow();
+		launched = statsNow();
+		if((b = findBuiltin(argv[0])) || cmdTab->sched || (substArgv && launchMode == LAUNCH_HELPER))
+			pid = forkProcess(b ? NULL : hashLookup(argv[0]), argv, pgid, foreground,
+				readfd, outfd, mask, b, cmdTab, i);
+		else
+			pid = launchProcess(hashLookup(argv[0]), argv, pgid, foreground,
+				readfd, outfd, mask);
+
+		/* Children have their copies, next process reads from the pipe */
+		if(readfd != infd)
+			close(readfd);
+		if(outfd != lastfd)
+			close(outfd);
+		readfd = pfd[0];
+		if(substArgv) {
+			for(int k = 0; k < cmdTab->numSubsts; k++)
+				if(cmdTab->substs[k].cmd == i)
+					close(substFds[k]);
+		}
+
+		if(pid == -1) {
+			free(substArgv);
+			arenaFree(&globMem);
+			continue;
+		}
+		recordLatency(STAT_LAUNCH, launched);
+		statCounters[COUNT_STARTED]++;
+
+		/* Set pgid's of all processes to pid of first process in job */
+		if(pgid == 0) {
+			pgid = pid;
+		}
+		if(interactive)
 			setpgid(pid, pgid);
+		traceLaunch(started, pid, pgid, argv);
+		free(substArgv);
+		arenaFree(&globMem);
+
+		/* Add child pid to job and to the pid index */
+		addProcess(newJob, pid);
+		if(owner && i == numPipes)
+			newJob->lastSlot = newJob->numPids - 1;
+	}
+	free(substFds);
+	return pgid;
+}
+
+/**
+ * @brief Starts the processes of a job
+ * 
+ * Given a command table, makes a job out of it and launches every process
+ * with launchProcess(), connecting them with pipes. The job takes over the
+ * command table, which is released right away if no process could be started.
+ * 
+ * @param cmdTab Pointer to command table
+ * @param infd Standard input of the first process, left open
+ * @param lastfd Standard output of the last process, left open
+ * @param pgid Process group to join, 0 to lead a new one
+ * @return Pointer to job, NULL if no process could be started
+ */
+job *launchJob(cmdTable *cmdTab, int infd, int lastfd, pid_t pgid) {
+	bool foreground = interactive && !cmdTab->isbackground;
+	sigset_t origMask;
+	job *newJob;
 
-			/* Add child pids to list of pids in job and incrmement count */
-			temp.pids[i] = pid;
-			temp.numProcs++;
+	/* Signal mask of the shell's caller, restored in children */
+	sigprocmask(SIG_SETMASK, NULL, &origMask);
+	sigdelset(&origMask, SIGCHLD);
 
-			/* Add job to job table after launching last process of that job */
-			if(i == numPipes) {
-				if(cmdTab->isbackground)
-					temp.status = BG;
-				else
-					temp.status = FG;
+	newJob = makeJob(cmdTab);
+	pgid = launchStages(newJob, cmdTab, infd, lastfd, pgid, foreground, &origMask, true);
+	newJob->pgid = pgid;
 
-				temp.pgid = pgid;
-				jobsTable[jobsTableIdx++] = temp;
-			}
+	if(newJob->numProcs == 0) {
+		removeJob(newJob);
+		return NULL;
+	}
+	return newJob;
+}
+
+/* Steps run by the child of a background and-or list */
+static cmdList *subshellList;
+static int subshellFirst, subshellEnd;
+
+static void runSteps(cmdList *list, int first, int end);
+
+/**
+ * @brief Runs the steps of a background and-or list in a child, as if it
+ * were a builtin
+ * 
+ * @return Status of the last pipeline run
+ */
+static int runSubshell(char **argv, cmdTable *cmdTab) {
+	/* The first step is the one marked to go in background, run it here */
+	executor(holdCmdTable(subshellList->steps[subshellFirst].cmdTab));
+	runSteps(subshellList, subshellFirst + 1, subshellEnd);
+	return lastStatus;
+}
+
+/**
+ * @brief Starts an and-or list of several pipelines put in background
+ * 
+ * Like a subshell, a child of the shell runs the pipelines one after the
+ * other, so that && and || see their statuses. It is a job of its own,
+ * shown by jobs with the whole list as its command line.
+ * 
+ * @param list Pointer to command list
+ * @param first Index of first step
+ * @param end Index past last step
+ */
+static void backgroundSteps(cmdList *list, int first, int end) {
+	static const builtin subshell = { "subshell", runSubshell, 0 };
+	cmdTable *cmdTab = malloc(sizeof(cmdTable));
+	size_t len = sizeof(" &");
+	sigset_t origMask;
+	char *c;
+	job *newJob;
+	pid_t pid;
+	long long started, launched;
+
+	if(cmdTab == NULL) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	/* Command line shown by jobs, a single argument naming nothing to run */
+	initCmdTable(cmdTab);
+	for(int i = first; i < end; i++)
+		len += strlen(list->steps[i].cmdTab->cmdLine) + sizeof(" && ");
+	cmdTab->cmdLine = c = arenaAlloc(&cmdTab->mem, len);
+	for(int i = first; i < end; i++) {
+		if(i > first)
+			c = stpcpy(c, list->steps[i].op == LIST_AND ? " && " : " || ");
+		c = stpcpy(c, list->steps[i].cmdTab->cmdLine);
+	}
+	strcpy(c, " &");
+	cmdTab->args = arenaAlloc(&cmdTab->mem, sizeof(char **));
+	cmdTab->args[0] = arenaAlloc(&cmdTab->mem, 2 * sizeof(char *));
+	cmdTab->args[0][0] = cmdTab->cmdLine;
+	cmdTab->args[0][1] = NULL;
+	cmdTab->numCmds = 1;
+	cmdTab->isbackground = true;
+
+	sigprocmask(SIG_SETMASK, NULL, &origMask);
+	sigdelset(&origMask, SIGCHLD);
+
+	subshellList = list;
+	subshellFirst = first;
+	subshellEnd = end;
+	newJob = makeJob(cmdTab);
+	started = traceNow();
+	launched = statsNow();
+	pid = forkProcess(NULL, cmdTab->args[0], 0, false, STDIN_FILENO, STDOUT_FILENO, &origMask, &subshell, cmdTab, 0);
+	if(pid == -1) {
+		removeJob(newJob);
+		lastStatus = 127;
+		return;
+	}
+	recordLatency(STAT_LAUNCH, launched);
+	statCounters[COUNT_STARTED]++;
+
+	if(interactive)
+		setpgid(pid, pid);
+	traceLaunch(started, pid, pid, cmdTab->args[0]);
+	addProcess(newJob, pid);
+	newJob->lastSlot = 0;
+	newJob->pgid = pid;
+	newJob->status = BG;
+	lastStatus = 0;
+}
+
+/**
+ * @brief Executes the job
+ * 
+ * Given a command table, opens the redirection files and starts the job
+ * with launchJob(). It waits if job was a foreground process.
+ * The job takes over the command table, which is released right away if no
+ * process could be started. A builtin on its own is run by the shell
+ * itself without starting a job.
+ * 
+ * @param cmdTab Pointer to command table
+ */
+void executor(cmdTable *cmdTab) {
+	int infd = STDIN_FILENO, lastfd = STDOUT_FILENO, status;
+	bool isbackground = cmdTab->isbackground, timed = cmdTab->timed;
+	struct rusage before, after;
+	struct timespec started = { 0, 0 };
+	long long waited;
+	const builtin *b = NULL;
+	job *newJob;
+
+	if(timed)
+		clock_gettime(CLOCK_MONOTONIC, &started);
+
+	/* Builtins and copies done by the shell use its own CPU time and memory,
+	   unless they are to run with other CPUs or priorities than the shell
+	   or with process substitutions */
+	if(cmdTab->numCmds == 1 && (cmdTab->args[0][0] == NULL || (b = findBuiltin(cmdTab->args[0][0])) || isCopyJob(cmdTab)) &&
+	   ((cmdTab->sched == NULL && cmdTab->numSubsts == 0) || (b && (b->flags & BUILTIN_WHOLE_LINE)))) {
+		getrusage(RUSAGE_SELF, &before);
+		if(b) {
+			lastStatus = runBuiltin(b, cmdTab);
+		}
+		else {
+			if(cmdTab->args[0][0])
+				lastStatus = runCopyJob(cmdTab);
+			releaseCmdTable(cmdTab);
 		}
+		if(timed) {
+			getrusage(RUSAGE_SELF, &after);
+			timersub(&after.ru_utime, &before.ru_utime, &after.ru_utime);
+			timersub(&after.ru_stime, &before.ru_stime, &after.ru_stime);
+			printTimes(&started, NULL, &after.ru_utime, &after.ru_stime, after.ru_maxrss);
+		}
+		return;
 	}
 
-	/* Close all pfds */
-	for(int j = 0; j < (2 * numPipes); j++) {
-		close(pfd[j]);
+	/* Set signal handlers for parent */
+	if(interactive) {
+		signal(SIGINT, SIG_IGN);
+		signal(SIGTSTP, SIG_IGN);
+		signal(SIGTTOU, SIG_IGN);
 	}
 
+	/* Open redirection files first so that a bad one starts nothing */
+	if(cmdTab->heredoc || cmdTab->heredocEnd) {
+		if((infd = openHeredoc(cmdTab)) == -1) {
+			perror("heredoc");
+			lastStatus = 1;
+			releaseCmdTable(cmdTab);
+			return;
+		}
+	}
+	else if(cmdTab->infile) {
+		infd = open(cmdTab->infile, READ_FLAGS | O_CLOEXEC, READ_MODES);
+		if(infd == -1) {
+			perror(cmdTab->infile);
+			lastStatus = 1;
+			releaseCmdTable(cmdTab);
+			return;
+		}
+	}
+	if(cmdTab->outfile) {
+		lastfd = open(cmdTab->outfile, CREATE_FLAGS | O_CLOEXEC, CREATE_MODES);
+		if(lastfd == -1) {
+			perror(cmdTab->outfile);
+			lastStatus = 1;
+			if(infd != STDIN_FILENO)
+				close(infd);
+			releaseCmdTable(cmdTab);
+			return;
+		}
+	}
+
+	newJob = launchJob(cmdTab, infd, lastfd, 0);
+
+	/* Children have their copies of the redirection files */
+	if(infd != STDIN_FILENO)
+		close(infd);
+	if(lastfd != STDOUT_FILENO)
+		close(lastfd);
+
+	/* Nothing to wait for if no process could be started */
+	if(newJob == NULL) {
+		lastStatus = 127;
+		return;
+	}
+	newJob->status = isbackground ? BG : FG;
+	newJob->timed = timed;
+	newJob->started = started;
+
+	/* Status of a pipeline is the one of its last process */
+	lastStatus = newJob->lastSlot == -1 ? 127 : 0;
+
 	/* Wait only if process group is running in foreground */
-	if(!cmdTab->isbackground) {
+	if(!isbackground) {
 		/* Set process group to foreground */
-		tcsetpgrp(STDIN_FILENO, pgid);
-
-		/* Wait for all processes in process group */
-		for(int j = 0; j < numPipes + 1; j++) {
-			if((tmp = waitpid(-pgid, &status, WUNTRACED)) == -1) {
-				if(errno == ECHILD)
-					break;
-				perror("executor: waitpid");
-			}
-			if(WIFEXITED(status)) {
-				/* Decrease count of running processes */
-				jobsTable[jobsTableIdx - 1].numProcs--;
-				if(jobsTable[jobsTableIdx - 1].numProcs == 0) {
-					jobsTableIdx--;
-				}
-			}
-			else if(WIFSIGNALED(status)) {
-				/* Decrease count of running processes */
-				jobsTableIdx--;
-				break;
-			}
-			else if(WIFSTOPPED(status)) {
-				/* Change status because stop signal was received */
-				jobsTable[jobsTableIdx - 1].status = STOPPED;
-				break;
-			}
+		if(interactive) {
+			tcsetpgrp(STDIN_FILENO, newJob->pgid);
+			traceTerminal(newJob->pgid);
 		}
+
+		/* Wait until every process of the job completed or it was stopped */
+		waited = traceNow();
+		status = waitForJob(newJob);
+		traceSpan("wait", waited, newJob->cmdTab->cmdLine);
+		if(newJob->status == STOPPED)
+			lastStatus = 128 + WSTOPSIG(status);
+		else
+			lastStatus = jobStatus(newJob);
+
 		/* Remove process group from job table if no more processes are running */
-		if(jobsTable[jobsTableIdx - 1].numProcs == 0) {
-			jobsTableIdx--;
+		if(newJob->numProcs == 0) {
+			if(timed)
+				printJobTimes(newJob);
+			removeJob(newJob);
 		}
 
 		/* Set shell to foreground again */
-		tcsetpgrp(STDIN_FILENO, getpgid(getpid()));
+		if(interactive) {
+			tcsetpgrp(STDIN_FILENO, getpgid(getpid()));
+			traceTerminal(getpgid(getpid()));
+		}
 	}
 
 	return;
 }
 
+/**
+ * @brief Runs steps [first, end) of a command list
+ * 
+ * A pipeline after && runs only if the status so far is 0, one after ||
+ * only if it is not, and a skipped pipeline leaves the status as it was.
+ * 
+ * @param list Pointer to command list
+ * @param first Index of first step
+ * @param end Index past last step
+ */
+static void runSteps(cmdList *list, int first, int end) {
+	for(int i = first; i < end && !exitRequested; i++) {
+		listStep *step = &list->steps[i];
+
+		if((step->op == LIST_AND && lastStatus != 0) || (step->op == LIST_OR && lastStatus == 0))
+			continue;
+
+		if(step->background) {
+			backgroundSteps(list, i, i + step->background);
+			i += step->background - 1;
+			continue;
+		}
+
+		/* The job takes its own reference, the list keeps the table */
+		executor(holdCmdTable(step->cmdTab));
+
+		/* Ctrl-C stops the whole line, not just the pipeline it hit */
+		if(interactive && lastStatus == 128 + SIGINT)
+			break;
+	}
+}
+
+/**
+ * @brief Runs the pipelines of a command list in order, skipping those
+ * whose && or || condition does not hold
+ * 
+ * @param list Pointer to command list
+ */
+void runList(cmdList *list) {
+	runSteps(list, 0, list->numSteps);
+}
+
 /**
  * @brief Bring the most recent stopped / background job to foreground
  * 
  */
 void fg() {
 
+	if(!interactive) {
+		printf("fg: no job control\n");
+		return;
+	}
+
 	/* Return if no background or stopped jobs */
-	if(jobsTableIdx <= 0) {
+	job *fgJob = lastJob();
+	if(fgJob == NULL) {
 		printf("No background or stopped jobs to send to foreground\n");
 		return;
 	}
 
-	pid_t tmp, pgid = jobsTable[jobsTableIdx - 1].pgid;
-	int status;
+	pid_t pgid = fgJob->pgid;
 
 	/* Set handlers */
 	signal(SIGINT, sigintHandler);
@@ -345,44 +869,30 @@ void fg() {
 
 	/* Set process group to foreground */
 	tcsetpgrp(STDIN_FILENO, pgid);
+	traceTerminal(pgid);
 
 	/* Send continue signal to process group */
 	kill(-pgid, SIGCONT);
+	traceContinue(pgid);
+	fgJob->status = FG;
 
-	/* Wait for process group */
-	for(int i = 0; i < jobsTable[jobsTableIdx - 1].numProcs; i++) {
-		if((tmp = waitpid(-pgid, &status, WUNTRACED)) == -1) {
-			if(errno == ECHILD)
-				continue;
-			perror("fg: waitpid");
-		}
-		if(WIFEXITED(status)) {
-			/* Decrease count of running processes */
-			jobsTable[i].numProcs--;
-			/* Remove process group from job table if no more processes are running */
-			if(jobsTable[i].numProcs == 0) {
-				jobsTableIdx--;
-			}
-		}
-		else if(WIFSIGNALED(status)) {
-			/* Decrease count of running processes */
-			jobsTableIdx--;
-			break;
-		}
-		else if(WIFSTOPPED(status)) {
-			/* Change status because stop signal was received */
-			jobsTable[jobsTableIdx - 1].status = STOPPED;
-		}
-	}
-	/* Remove process group from job table if no more processes are running */
-	if(jobsTable[jobsTableIdx - 1].numProcs == 0) {
-		jobsTableIdx--;
+	/* Wait for process group until it completes or stops again */
+	long long waited = traceNow();
+	waitForJob(fgJob);
+	traceSpan("wait", waited, fgJob->cmdTab->cmdLine);
+	/* Remove process group from job table if no more processes are running,
+	 * unless a parallel run still has to report it */
+	if(fgJob->numProcs == 0 && fgJob->runner == NULL) {
+		if(fgJob->timed)
+			printJobTimes(fgJob);
+		removeJob(fgJob);
 	}
 
 	signal(SIGTTOU, SIG_IGN);
 
 	/* Set shell to foreground */
 	tcsetpgrp(STDIN_FILENO, getpgid(getpid()));
+	traceTerminal(getpgid(getpid()));
 }
 
 /**
@@ -391,6 +901,11 @@ void fg() {
  */
 void bg() {
 
+	if(!interactive) {
+		printf("bg: no job control\n");
+		return;
+	}
+
 	/* Check if there are background or stopped jobs if any */
 	if(jobsTableIdx <= 0) {
 		printf("No stopped jobs to send to background\n");
@@ -399,28 +914,106 @@ void bg() {
 
 	for(int i = jobsTableIdx - 1; i >= 0; i--) {
 		/* Find most recent STOPPED job */
-		if(jobsTable[i].status == STOPPED) {
+		if(jobsTable[i] && jobsTable[i]->status == STOPPED) {
 			/* Send continue signal */
-			if(kill(-jobsTable[i].pgid, SIGCONT) < 0) {
+			if(kill(-jobsTable[i]->pgid, SIGCONT) < 0) {
 				perror("bg: ");
 			}
+			traceContinue(jobsTable[i]->pgid);
 
 			/* Update status in job table */
-			jobsTable[i].status = BG;
+			jobsTable[i]->status = BG;
 			break;
 		}
 	}
 }
 
 /**
- * @brief Frees the global job table
+ * @brief Waits for input while keeping track of children
+ * 
+ * Used as the wait hook of the input reader, this is the event loop of
+ * the shell: children that exit or stop while it waits for a line are
+ * reaped right away and completed jobs are reported.
  * 
+ * @param fd Descriptor input is read from
  */
-void freeJobsTable() {
-	for(int i = 0; i < jobsTableIdx; i++) {
-		freeCmdTable(&jobsTable[i].cmdTab);
+static void waitForInput(int fd) {
+	int seen, reported;
+
+	if(!watchInput(fd))
+		return;
+
+	do {
+		seen = waitEvents();
+		if(seen & EVENT_CHILD) {
+			reapChildren();
+			reported = notifyJobs();
+			reported += pollParallel();
+			if(reported && interactive)
+				showPrompt();
+		}
+	} while(!(seen & EVENT_INPUT));
+}
+
+/**
+ * @brief Reads the bodies of the here-documents of a line
+ * 
+ * Every <<END in the line takes the lines after it up to one that is END.
+ * They are joined to the line with newlines, for parseList to take them
+ * apart again, so that the parse cache tells apart runs of the same line
+ * with other bodies.
+ * 
+ * @param in Pointer to reader
+ * @param line Line, which may be in the buffer of the reader
+ * @return Line followed by the bodies, valid until the next call, or line
+ * itself if it has no here-document
+ */
+static char *readHeredocs(inputReader *in, char *line) {
+	static char *buf = NULL;
+	static size_t size = 0;
+	size_t used = strlen(line), pos = 0, endPos, endLen, len;
+	char *end, *body;
+
+	if(findHeredoc(line, &endLen) == NULL)
+		return line;
+
+	/* Lines read next may move the buffer of the reader */
+	if(used + 1 > size) {
+		size = used + 1;
+		if((buf = realloc(buf, size)) == NULL) {
+			perror("malloc");
+			exit(EXIT_FAILURE);
+		}
 	}
-	return;
+	memcpy(buf, line, used + 1);
+
+	while((end = findHeredoc(buf + pos, &endLen))) {
+		endPos = end - buf;
+		pos = endPos + endLen;
+		while(1) {
+			if(interactive) {
+				printf("> ");
+				fflush(stdout);
+			}
+			if((body = readLine(in)) == NULL)
+				return buf;
+
+			len = strlen(body);
+			if(used + len + 2 > size) {
+				size = 2 * (used + len + 2);
+				if((buf = realloc(buf, size)) == NULL) {
+					perror("malloc");
+					exit(EXIT_FAILURE);
+				}
+			}
+			buf[used++] = '\n';
+			memcpy(buf + used, body, len + 1);
+			used += len;
+			if(len == endLen && strncmp(body, buf + endPos, endLen) == 0)
+				break;
+		}
+	}
+	return buf;
 }
 
 /**
@@ -428,57 +1021,136 @@ void freeJobsTable() {
  * 
  * Accepts a command line as input, parses it, executes it and then
  * finally frees it for every command until shell has exited.
+ * Run as "fsh -c command" or "fsh file" the shell reads its lines from
+ * the string or the file without printing prompts or doing job control,
+ * as it also does when standard input is not a terminal.
  * 
- * @return int 0 if success, errno on failure
+ * @param argc Number of arguments
+ * @param argv Arguments
+ * @return int exit status of the last job
  */
-int main() {
-	char *cmdLine = malloc(CMD_SIZE * sizeof(char));
+int main(int argc, char *argv[]) {
+	inputReader in;
+	char *cmdLine;
+	sigset_t chldMask;
+
+	/* Children are seen through pidfds or a signalfd, never a handler */
+	sigemptyset(&chldMask);
+	sigaddset(&chldMask, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &chldMask, NULL);
+	initEvents();
+
+	if(argc > 1 && strcmp(argv[1], "-c") == 0) {
+		if(argc < 3) {
+			fprintf(stderr, "usage: fsh [-c command | file]\n");
+			return 2;
+		}
+		openStringReader(&in, argv[2]);
+		interactive = false;
+	}
+	else if(argc > 1) {
+		int fd = open(argv[1], READ_FLAGS | O_CLOEXEC);
+		if(fd == -1) {
+			perror(argv[1]);
+			return 127;
+		}
+		openReader(&in, fd);
+		in.wait = waitForInput;
+		interactive = false;
+	}
+	else {
+		openReader(&in, STDIN_FILENO);
+		in.wait = waitForInput;
+		interactive = isatty(STDIN_FILENO);
+	}
+
+	/* Process launch backend, posix_spawn unless asked otherwise */
+	char *mode = getenv("FSH_LAUNCH");
+	if(mode && strcmp(mode, "fork") == 0) {
+		launchMode = LAUNCH_FORK;
+	}
+	else if(mode && strcmp(mode, "helper") == 0) {
+		if(startLauncher() == 0)
+			launchMode = LAUNCH_HELPER;
+		else
+			perror("launcher");
+	}
+
+	/* Timeline of the shell and its children, recorded when asked for */
+	char *trace = getenv("FSH_TRACE");
+	if(trace && trace[0] && startTrace(trace) == -1)
+		perror(trace);
+
+	/* Capacity of pipes between processes, the kernel default unless asked otherwise */
+	char *size = getenv("FSH_PIPE_SIZE");
+	if(size && setPipeSize(atol(size)) == -1)
+		perror("FSH_PIPE_SIZE");
 
 	/* To handle Ctrl+C and Ctrl+Z signals */
-	signal(SIGINT,  sigintHandler);
-   	signal(SIGTSTP, sigtstpHandler);
-   	signal(SIGCHLD, sigchldHandler);
+	if(interactive) {
+		initPrompt();
+		initHistory();
+		signal(SIGINT,  sigintHandler);
+		signal(SIGTSTP, sigtstpHandler);
+	}
 
 	while (1) {
-		printPrompt();
+		/* Report jobs that completed while the last line ran */
+		reapChildren();
+		notifyJobs();
+		pollParallel();
+		if(interactive)
+			showPrompt();
 
-		fgets(cmdLine, 1024, stdin);
-		cmdLine[strcspn(cmdLine, "\n")] = '\0';
-		if(!strlen(cmdLine))
-			continue;
-
-		/* Check for builtin commands */
-		if(strcmp(cmdLine, "exit") == 0) {
+		long long started = traceNow();
+		if((cmdLine = readLine(&in)) == NULL)
 			break;
-		}
-		else if(strcmp(cmdLine, "fg") == 0) {
-			fg();
-			continue;
-		}
-		else if(strcmp(cmdLine, "bg") == 0) {
-			bg();
+		traceSpan("read", started, NULL);
+
+		/* Skip blank lines and comments such as the #! line of a script */
+		cmdLine += strspn(cmdLine, " \t");
+		if(cmdLine[0] == '\0' || cmdLine[0] == '#')
 			continue;
+
+		/* Recall !-lines from the history, then record the line as run */
+		if(interactive) {
+			char *line = expandHistory(cmdLine);
+			if(line == NULL) {
+				lastStatus = 1;
+				continue;
+			}
+			if(line != cmdLine)
+				printf("%s\n", line);
+			addHistory(line);
+			cmdLine = line;
 		}
-		else if(strcmp(cmdLine, "jobs") == 0) {
-			printJobsTable();
-			continue;
+
+		/* Bodies of here-documents follow the line */
+		cmdLine = readHeredocs(&in, cmdLine);
+
+		/* Run every pipeline of the line, jobs take their own references */
+		statCounters[COUNT_LINES]++;
+		started = traceNow();
+		cmdList *list = parseCached(cmdLine);
+		traceSpan("parse", started, cmdLine);
+		if(list) {
+			runList(list);
+			releaseCmdList(list);
 		}
-		else if(strncmp(cmdLine, "cd ", 3) == 0) {
-			char *token = strtok(cmdLine, " ");
-			token = strtok(NULL, " ");
-			if(chdir(token) == -1) {
-				perror("cd");
-			}
-			continue;
+		else {
+			lastStatus = 2;
 		}
 
-		cmdTable *cmdTab = calloc(1, sizeof(cmdTable));
-		initCmdTable(cmdTab);
-		parse(cmdLine, cmdTab);
-		executor(cmdTab);
-		free(cmdTab);
+		if(exitRequested)
+			break;
 	}
 
+	closeReader(&in);
+	freeHistory();
+	clearCache();
+	stopLauncher();
+	stopTrace();
+	freeParallel();
 	freeJobsTable();
-	return 0;
+	return lastStatus;
 }
\ No newline at end of file
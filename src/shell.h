@@ -1,12 +1,6 @@
 #include <sys/types.h>
 #include <unistd.h>
-#include "parse.h"
-
-/* Maximum character limit on command */
-#define CMD_SIZE 1024
-
-/* Max number of processes allowed in a group */
-#define MAX_PROCS_IN_GROUP 16
+#include "jobs.h"
 
 /* Flags needed while reading/writing a file */
 #define READ_FLAGS (O_RDONLY)
@@ -21,39 +15,43 @@
 #define GRN   "\x1B[32m"
 #define RESET "\x1B[0m"
 
-/* States a process or a job can be in */
+/* Ways of starting the processes of a job, chosen with FSH_LAUNCH */
 typedef enum {
-	FG, BG, STOPPED
-} ProcState;
-
-/* Structure to store information for a process group or a job */
-typedef struct {
-	/* To store all information regarding processes in that group */
-	cmdTable cmdTab;
-	/* Process Group ID of the job */
-	pid_t pgid;
-	/* Process IDs of the processes in the job */
-	pid_t pids[MAX_PROCS_IN_GROUP];
-	/* Number of processes running or stopped i.e. not completed */
-	int numProcs;
-	/* Status of job */
-	ProcState status;
-} job;
-
-/* A stack of jobs with index to implement job control */
-job jobsTable[16];
-int jobsTableIdx = 0;
+	LAUNCH_SPAWN, LAUNCH_FORK, LAUNCH_HELPER
+} LaunchMode;
+
+/* Whether the shell reads from a terminal and does job control */
+extern bool interactive;
+
+/* Exit status of the last foreground job or builtin */
+extern int lastStatus;
+
+/* Launch backend used by executor */
+extern LaunchMode launchMode;
+
+/* Set by the exit builtin, the shell exits after the current command line */
+extern bool exitRequested;
+
+/* Environment handed to every launched process */
+extern char **environ;
+
+/* Room for the rendered prompt, the working directory being most of it */
+#define PROMPT_SIZE (PATH_MAX + 512)
 
 /**
- * Function to print prompt in a pretty way
+ * Resolve user and host name once and render the prompt
  */
-void printPrompt();
+void initPrompt();
 
 /**
- * Handler for SIGCHLD signal
- * @param signum signal number for corresponding signal
+ * Render the prompt again after the working directory changed
  */
-void sigchldHandler(int signum);
+void updatePrompt();
+
+/**
+ * Function to print prompt in a pretty way, with a single write
+ */
+void printPrompt();
 
 /**
  * Handler for SIGINT signal or Ctrl-C
@@ -68,16 +66,35 @@ void sigintHandler(int signum);
 void sigtstpHandler(int signum);
 
 /**
- * Function to print jobs table using global array of jobs
+ * Starts one process of a job with the selected launch backend
+ * @param file file to execute, searched in PATH if it has no slash
+ * @param argv NULL terminated argument vector
+ * @param pgid process group to join, 0 to lead a new one
+ * @param foreground whether the job gets the terminal
+ * @param infd descriptor to use as standard input
+ * @param outfd descriptor to use as standard output
+ * @param mask signal mask for the new process
+ * @return pid of the new process, -1 on failure
+ */
+pid_t launchProcess(char *file, char **argv, pid_t pgid, bool foreground, int infd, int outfd, sigset_t *mask);
+
+/**
+ * Start every process of a command table as a new job
+ * @param cmdTab pointer to command table, owned by the job from now on
+ * @param infd standard input of the first process, left open
+ * @param lastfd standard output of the last process, left open
+ * @param pgid process group to join, 0 to lead a new one
+ * @return pointer to job, NULL if no process could be started
  */
-void printJobsTable();
+job *launchJob(cmdTable *cmdTab, int infd, int lastfd, pid_t pgid);
 
 /**
- * Initialise an empty job
+ * Put the here-document or here-string of a command table in a memory
+ * file, to be the standard input of its first command
  * @param cmdTab pointer to command table
- * @return initialised job 
+ * @return descriptor of the file at its start, -1 on failure with errno set
  */
-job makeJob(cmdTable *cmdTab);
+int openHeredoc(cmdTable *cmdTab);
 
 /**
  * Executes commands
@@ -86,16 +103,18 @@ job makeJob(cmdTable *cmdTab);
 void executor(cmdTable *cmdTab);
 
 /**
- * Run job at top of stack, in foreground 
+ * Runs the pipelines of a command list in order, skipping those whose
+ * && or || condition does not hold
+ * @param list pointer to command list
  */
-void fg();
+void runList(cmdList *list);
 
 /**
- * Run most recent STOPPED job, in background
+ * Run job at top of stack, in foreground 
  */
-void bg();
+void fg();
 
 /**
- * Frees jobs table 
+ * Run most recent STOPPED job, in background
  */
-void freeJobsTable();
+void bg();
\ No newline at end of file
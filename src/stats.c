@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+/**
+ * Latencies in nanoseconds, counted in buckets that are linear within each
+ * power of two like those of an HDR histogram: recording one is a handful
+ * of instructions and percentiles are within 1/16 of the exact value.
+ */
+typedef struct histogram {
+	unsigned long long counts[STATS_BUCKETS];
+	unsigned long long count;
+	unsigned long long sum;
+	unsigned long long min;
+	unsigned long long max;
+} histogram;
+
+unsigned long statCounters[NUM_COUNTERS];
+long long childrenSeen = 0;
+
+static histogram histograms[NUM_HISTOGRAMS];
+
+/* Names shown by stats, in the order of the enums */
+static const char *histogramNames[NUM_HISTOGRAMS] = { "parse", "launch", "reap", "prompt" };
+static const char *counterNames[NUM_COUNTERS] = { "lines", "parsed", "started", "reaped", "stopped" };
+
+/* Percentiles shown for every histogram */
+static const double percentiles[] = { 50, 90, 99, 99.9 };
+
+/**
+ * @brief Finds the bucket of a value
+ * 
+ * Values below STATS_SUB_BUCKETS have a bucket each. Above, the position
+ * of the highest bit picks a power of two and the STATS_SUB_BITS bits
+ * after it the bucket within it.
+ * 
+ * @param value Value
+ * @return Index of bucket
+ */
+static int bucketOf(unsigned long long value) {
+	int shift;
+
+	if(value < STATS_SUB_BUCKETS)
+		return value;
+	shift = 63 - __builtin_clzll(value) - STATS_SUB_BITS;
+	return (shift + 1) * STATS_SUB_BUCKETS + ((value >> shift) & (STATS_SUB_BUCKETS - 1));
+}
+
+/**
+ * @brief Highest value that falls in a bucket
+ * 
+ * @param bucket Index of bucket
+ * @return Value
+ */
+static unsigned long long bucketTop(int bucket) {
+	int shift = bucket / STATS_SUB_BUCKETS - 1;
+
+	if(shift < 0)
+		return bucket;
+	return ((unsigned long long)(STATS_SUB_BUCKETS + bucket % STATS_SUB_BUCKETS) << shift) + (1ULL << shift) - 1;
+}
+
+/**
+ * @brief Current time for a latency
+ * 
+ * @return Nanoseconds from CLOCK_MONOTONIC
+ */
+long long statsNow() {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Add the time elapsed since start to a histogram
+ * 
+ * @param h Histogram
+ * @param start Time it started, from statsNow
+ */
+void recordLatency(StatHistogram h, long long start) {
+	long long elapsed = statsNow() - start;
+	unsigned long long value = elapsed > 0 ? elapsed : 0;
+	histogram *hist = &histograms[h];
+
+	hist->counts[bucketOf(value)]++;
+	if(hist->count++ == 0 || value < hist->min)
+		hist->min = value;
+	if(value > hist->max)
+		hist->max = value;
+	hist->sum += value;
+}
+
+/**
+ * @brief Value below which a percentage of a histogram falls
+ * 
+ * Reported as the top of its bucket, but never above the largest value
+ * recorded.
+ * 
+ * @param hist Pointer to histogram, not empty
+ * @param percentile Percentage
+ * @return Value
+ */
+static unsigned long long valueAt(const histogram *hist, double percentile) {
+	unsigned long long rank = (unsigned long long)(percentile / 100 * hist->count + 0.5), seen = 0;
+	unsigned long long top;
+
+	if(rank == 0)
+		rank = 1;
+	for(int i = 0; i < STATS_BUCKETS; i++) {
+		if((seen += hist->counts[i]) >= rank) {
+			top = bucketTop(i);
+			return top < hist->max ? top : hist->max;
+		}
+	}
+	return hist->max;
+}
+
+/**
+ * @brief Prints a latency in a unit that keeps it short
+ * 
+ * @param ns Nanoseconds
+ */
+static void printLatency(unsigned long long ns) {
+	if(ns < 1000)
+		printf("\t%lluns", ns);
+	else if(ns < 1000000)
+		printf("\t%.1fus", ns / 1e3);
+	else if(ns < 1000000000)
+		printf("\t%.1fms", ns / 1e6);
+	else
+		printf("\t%.2fs", ns / 1e9);
+}
+
+/**
+ * @brief Print the counters and the percentiles of every histogram
+ * 
+ */
+void printStats() {
+	const histogram *hist;
+
+	for(int i = 0; i < NUM_COUNTERS; i++)
+		printf("%s\t\t%lu\n", counterNames[i], statCounters[i]);
+
+	printf("\n\t\tcount\tmin");
+	for(size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++)
+		printf("\tp%g", percentiles[p]);
+	printf("\tmax\tmean\n");
+
+	for(int i = 0; i < NUM_HISTOGRAMS; i++) {
+		hist = &histograms[i];
+		printf("%s\t\t%llu", histogramNames[i], hist->count);
+		if(hist->count == 0) {
+			printf("\n");
+			continue;
+		}
+		printLatency(hist->min);
+		for(size_t p = 0; p < sizeof(percentiles) / sizeof(percentiles[0]); p++)
+			printLatency(valueAt(hist, percentiles[p]));
+		printLatency(hist->max);
+		printLatency(hist->sum / hist->count);
+		printf("\n");
+	}
+}
+
+/**
+ * @brief Clear the counters and histograms
+ * 
+ */
+void resetStats() {
+	memset(statCounters, 0, sizeof(statCounters));
+	memset(histograms, 0, sizeof(histograms));
+}
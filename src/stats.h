@@ -0,0 +1,54 @@
+/* Sub-buckets in each power of two, values sharing one differ by less than 1/16 */
+#define STATS_SUB_BITS 4
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+
+/* Buckets for any number of nanoseconds up to 2^64 */
+#define STATS_BUCKETS ((64 - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS)
+
+/* Latencies kept in a histogram */
+typedef enum {
+	STAT_PARSE,
+	STAT_LAUNCH,
+	STAT_REAP,
+	STAT_PROMPT,
+	NUM_HISTOGRAMS
+} StatHistogram;
+
+/* Events counted */
+typedef enum {
+	COUNT_LINES,
+	COUNT_PARSED,
+	COUNT_STARTED,
+	COUNT_REAPED,
+	COUNT_STOPPED,
+	NUM_COUNTERS
+} StatCounter;
+
+/* Counts of events since the shell started or stats --reset */
+extern unsigned long statCounters[NUM_COUNTERS];
+
+/* Time the shell was last woken for a child, 0 once it was reaped */
+extern long long childrenSeen;
+
+/**
+ * Current time for a latency
+ * @return nanoseconds from CLOCK_MONOTONIC
+ */
+long long statsNow();
+
+/**
+ * Add the time elapsed since start to a histogram
+ * @param h histogram
+ * @param start time it started, from statsNow
+ */
+void recordLatency(StatHistogram h, long long start);
+
+/**
+ * Print the counters and the percentiles of every histogram
+ */
+void printStats();
+
+/**
+ * Clear the counters and histograms
+ */
+void resetStats();
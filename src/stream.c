@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include "shell.h"
+#include "stream.h"
+
+/* Capacity of the pipes between processes of a job, 0 for the kernel default */
+int pipeSize = 0;
+
+/* Set by Ctrl-C while the shell copies */
+static volatile sig_atomic_t copyInterrupted = 0;
+
+/**
+ * @brief Sets the capacity of the pipes of new jobs
+ * 
+ * The size is tried on a pipe first, so that what is stored is what the
+ * kernel really gives and a size over /proc/sys/fs/pipe-max-size is
+ * refused here rather than for every job.
+ * 
+ * @param size Capacity in bytes, 0 for the kernel default
+ * @return Capacity the kernel gives, -1 if it refused it
+ */
+int setPipeSize(long size) {
+	int pfd[2], capacity;
+
+	if(size < 0 || size > INT_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+	if(pipe2(pfd, O_CLOEXEC) == -1)
+		return -1;
+
+	if(size == 0)
+		capacity = fcntl(pfd[0], F_GETPIPE_SZ);
+	else
+		capacity = fcntl(pfd[0], F_SETPIPE_SZ, (int)size);
+	close(pfd[0]);
+	close(pfd[1]);
+
+	if(capacity == -1)
+		return -1;
+	pipeSize = size ? capacity : 0;
+	return capacity;
+}
+
+/**
+ * @brief Applies the pipe capacity setting to a new pipe
+ * 
+ * Failures are ignored, as the pipe still works with its default size.
+ * 
+ * @param fd Either end of the pipe
+ */
+void sizePipe(int fd) {
+	if(pipeSize)
+		fcntl(fd, F_SETPIPE_SZ, pipeSize);
+}
+
+/**
+ * @brief Tells whether a command table only copies a file
+ * 
+ * That is a lone cat in foreground without options, reading from its input
+ * redirection or from a single file given as argument, and writing to a
+ * file or pipe. One writing to the terminal is left to a real cat, which
+ * can be stopped with Ctrl-Z like any job.
+ * 
+ * @param cmdTab Pointer to command table
+ * @return true if it is such a copy
+ */
+bool isCopyJob(cmdTable *cmdTab) {
+	char **argv = cmdTab->args[0];
+
+	/* A word with wildcards may name any number of files */
+	if(cmdTab->numCmds != 1 || cmdTab->isbackground || cmdTab->globs || strcmp(argv[0], "cat") != 0)
+		return false;
+	if(cmdTab->outfile == NULL && isatty(STDOUT_FILENO))
+		return false;
+	if(cmdTab->infile)
+		return argv[1] == NULL;
+	return argv[1] && argv[1][0] != '-' && argv[2] == NULL;
+}
+
+/**
+ * @brief Handler for SIGINT while the shell copies
+ * 
+ * @param signum Integer
+ */
+static void copySigintHandler(int signum) {
+	copyInterrupted = 1;
+}
+
+/**
+ * @brief Writes all of a buffer
+ * 
+ * @param fd Descriptor to write to
+ * @param buf Data
+ * @param len Number of bytes
+ * @return 0 on success, -1 on error
+ */
+static int writeAll(int fd, const char *buf, size_t len) {
+	ssize_t n;
+
+	while(len > 0) {
+		if((n = write(fd, buf, len)) == -1) {
+			if(errno == EINTR && !copyInterrupted)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * @brief Copies everything from one descriptor to another
+ * 
+ * Tries the calls that keep data in the kernel in order of preference and
+ * moves on to the next one when a call does not support the descriptors:
+ * copy_file_range between files (which may share extents on the same
+ * filesystem), sendfile from a file to anything, splice to or from a pipe,
+ * and read/write when nothing else works.
+ * 
+ * @param infd Descriptor to read from
+ * @param outfd Descriptor to write to
+ * @return 0 on success, -1 on error
+ */
+static int copyData(int infd, int outfd) {
+	enum { COPY_RANGE, SEND_FILE, SPLICE, READ_WRITE } method = COPY_RANGE;
+	char *buf = NULL;
+	ssize_t n;
+
+	while(!copyInterrupted) {
+		switch(method) {
+		case COPY_RANGE:
+			n = copy_file_range(infd, NULL, outfd, NULL, COPY_CHUNK, 0);
+			break;
+		case SEND_FILE:
+			n = sendfile(outfd, infd, NULL, COPY_CHUNK);
+			break;
+		case SPLICE:
+			n = splice(infd, NULL, outfd, NULL, COPY_CHUNK, SPLICE_F_MOVE);
+			break;
+		default:
+			if(buf == NULL && (buf = malloc(COPY_BUF_SIZE)) == NULL)
+				return -1;
+			if((n = read(infd, buf, COPY_BUF_SIZE)) > 0 && writeAll(outfd, buf, n) == -1)
+				n = -1;
+			break;
+		}
+
+		if(n == 0)
+			break;
+		if(n > 0 || errno == EINTR)
+			continue;
+
+		/* Descriptors not supported by this call, nothing was copied by it */
+		if(method != READ_WRITE && (errno == EINVAL || errno == EXDEV || errno == ENOSYS ||
+		   errno == EOPNOTSUPP || errno == EBADF)) {
+			method++;
+			continue;
+		}
+		free(buf);
+		return -1;
+	}
+
+	free(buf);
+	return 0;
+}
+
+/**
+ * @brief Copies a file in the shell instead of running cat
+ * 
+ * Ctrl-C stops the copy between two chunks, as it would stop cat.
+ * 
+ * @param cmdTab Pointer to command table
+ * @return Exit status, as cat would have it
+ */
+int runCopyJob(cmdTable *cmdTab) {
+	char *infile = cmdTab->infile ? cmdTab->infile : cmdTab->args[0][1];
+	int infd, outfd = STDOUT_FILENO, status = 0;
+	struct sigaction action, oldAction;
+
+	/* Messages are those of cat, whose place the shell takes */
+	if((infd = open(infile, READ_FLAGS | O_CLOEXEC)) == -1) {
+		fprintf(stderr, "cat: %s: %s\n", infile, strerror(errno));
+		return 1;
+	}
+	if(cmdTab->outfile) {
+		outfd = open(cmdTab->outfile, CREATE_FLAGS | O_CLOEXEC, CREATE_MODES);
+		if(outfd == -1) {
+			perror(cmdTab->outfile);
+			close(infd);
+			return 1;
+		}
+	}
+
+	if(interactive) {
+		memset(&action, 0, sizeof(action));
+		action.sa_handler = copySigintHandler;
+		sigaction(SIGINT, &action, &oldAction);
+	}
+	copyInterrupted = 0;
+	fflush(stdout);
+
+	if(copyData(infd, outfd) == -1) {
+		perror("cat");
+		status = 1;
+	}
+	if(copyInterrupted)
+		status = 128 + SIGINT;
+
+	if(interactive)
+		sigaction(SIGINT, &oldAction, NULL);
+	close(infd);
+	if(outfd != STDOUT_FILENO)
+		close(outfd);
+	return status;
+}
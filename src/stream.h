@@ -0,0 +1,37 @@
+/* Bytes moved by one copy_file_range, sendfile or splice call */
+#define COPY_CHUNK (8 << 20)
+
+/* Size of the buffer used when the file descriptors allow no zero-copy call */
+#define COPY_BUF_SIZE 65536
+
+/* Capacity of the pipes between processes of a job, 0 for the kernel default */
+extern int pipeSize;
+
+/**
+ * Set the capacity of the pipes of new jobs
+ * @param size capacity in bytes, 0 for the kernel default
+ * @return capacity the kernel gives, which is rounded up to a power of two
+ * pages, -1 if it refused it
+ */
+int setPipeSize(long size);
+
+/**
+ * Apply the pipe capacity setting to a new pipe
+ * @param fd either end of the pipe
+ */
+void sizePipe(int fd);
+
+/**
+ * Tell whether a command table only copies a file, like "cat < in > out",
+ * so that the shell can do the copy itself
+ * @param cmdTab pointer to command table
+ * @return true if it is such a copy
+ */
+bool isCopyJob(cmdTable *cmdTab);
+
+/**
+ * Do the copy of a command table for which isCopyJob is true, in the shell
+ * @param cmdTab pointer to command table
+ * @return exit status, as cat would have it
+ */
+int runCopyJob(cmdTable *cmdTab);
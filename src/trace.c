@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "trace.h"
+
+bool tracing = false;
+
+/* File events are written to, and its name */
+static int traceFd = -1;
+static char *tracePath = NULL;
+
+/* Events not written yet, and the number recorded so far */
+static char traceBuf[TRACE_BUF_SIZE];
+static size_t traceUsed = 0;
+static unsigned long traceEvents = 0;
+
+/* Shell the trace belongs to, whose own spans are on the track of its pid */
+static pid_t tracePid;
+
+/**
+ * @brief Writes the buffered events to the trace file
+ * 
+ * Tracing stops if the file cannot be written.
+ * 
+ */
+static void flushTrace() {
+	size_t done = 0;
+	ssize_t n;
+
+	while(done < traceUsed) {
+		if((n = write(traceFd, traceBuf + done, traceUsed - done)) == -1) {
+			if(errno == EINTR)
+				continue;
+			perror(tracePath);
+			dropTrace();
+			return;
+		}
+		done += n;
+	}
+	traceUsed = 0;
+}
+
+/**
+ * @brief Adds formatted text to the buffer, which has room for it
+ * 
+ * @param fmt printf format
+ */
+static void appendf(const char *fmt, ...) {
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(traceBuf + traceUsed, TRACE_BUF_SIZE - traceUsed, fmt, ap);
+	va_end(ap);
+	if(n > 0)
+		traceUsed += (size_t)n < TRACE_BUF_SIZE - traceUsed ? (size_t)n : TRACE_BUF_SIZE - traceUsed - 1;
+}
+
+/**
+ * @brief Adds a JSON string to the buffer, cut at TRACE_LINE_MAX bytes
+ * 
+ * @param str String
+ */
+static void appendString(const char *str) {
+	char *c = traceBuf + traceUsed;
+
+	*c++ = '"';
+	for(size_t i = 0; str[i] && i < TRACE_LINE_MAX; i++) {
+		unsigned char ch = str[i];
+		if(ch == '"' || ch == '\\') {
+			*c++ = '\\';
+			*c++ = ch;
+		}
+		else if(ch < 0x20) {
+			c += sprintf(c, "\\u%04x", ch);
+		}
+		else {
+			*c++ = ch;
+		}
+	}
+	*c++ = '"';
+	traceUsed = c - traceBuf;
+}
+
+/**
+ * @brief Starts an event, making room for it first
+ * 
+ * The caller adds its fields and closes it with endEvent.
+ * 
+ * @param name Name of event
+ * @param phase Event type, e.g. X for a span or i for an instant
+ * @param ts Time of event, from traceNow
+ * @param tid Track of event, the shell's pid or that of a child
+ */
+static void beginEvent(const char *name, char phase, long long ts, pid_t tid) {
+	if(TRACE_BUF_SIZE - traceUsed < TRACE_EVENT_MAX)
+		flushTrace();
+	if(traceEvents++)
+		appendf(",\n");
+	appendf("{\"name\":");
+	appendString(name);
+	appendf(",\"ph\":\"%c\",\"ts\":%lld.%03lld,\"pid\":%d,\"tid\":%d", phase, ts / 1000, ts % 1000, tracePid, tid);
+}
+
+/**
+ * @brief Ends an event
+ * 
+ */
+static void endEvent() {
+	appendf("}");
+}
+
+/**
+ * @brief Names the track of a process, shown instead of its pid
+ * 
+ * @param tid Track
+ * @param name Name
+ */
+static void nameTrack(pid_t tid, const char *name) {
+	beginEvent("thread_name", 'M', 0, tid);
+	appendf(",\"args\":{\"name\":");
+	appendString(name);
+	appendf("}");
+	endEvent();
+}
+
+/**
+ * @brief Start recording events to a file in Chrome Trace Event JSON
+ * 
+ * Any trace already running is stopped first. The file can be opened in
+ * chrome://tracing or Perfetto.
+ * 
+ * @param path File to write, truncated
+ * @return 0 on success, -1 if it could not be opened
+ */
+int startTrace(const char *path) {
+	int fd;
+
+	stopTrace();
+	if((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1)
+		return -1;
+
+	traceFd = fd;
+	tracePath = strdup(path);
+	tracePid = getpid();
+	traceUsed = 0;
+	traceEvents = 0;
+	tracing = true;
+
+	appendf("[\n");
+	beginEvent("process_name", 'M', 0, tracePid);
+	appendf(",\"args\":{\"name\":\"fsh\"}");
+	endEvent();
+	nameTrack(tracePid, "shell");
+	return 0;
+}
+
+/**
+ * @brief Write the events still buffered, end the JSON array and close
+ * the file
+ * 
+ */
+void stopTrace() {
+	if(!tracing)
+		return;
+	appendf("\n]\n");
+	flushTrace();
+	if(tracing)
+		dropTrace();
+}
+
+/**
+ * @brief Forget the trace without writing anything
+ * 
+ */
+void dropTrace() {
+	if(traceFd != -1)
+		close(traceFd);
+	free(tracePath);
+	traceFd = -1;
+	tracePath = NULL;
+	traceUsed = 0;
+	tracing = false;
+}
+
+/**
+ * @brief Print the file being traced to and the number of events recorded
+ * 
+ */
+void printTraceStatus() {
+	if(tracing)
+		printf("tracing to %s, %lu events\n", tracePath, traceEvents);
+	else
+		printf("not tracing\n");
+}
+
+/**
+ * @brief Current time for a trace event
+ * 
+ * @return Nanoseconds from CLOCK_MONOTONIC, 0 while not tracing
+ */
+long long traceNow() {
+	struct timespec now;
+
+	if(!tracing)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+/**
+ * @brief Record a span of the shell itself
+ * 
+ * @param name Name of the span
+ * @param start Time it started, from traceNow
+ * @param text Text to attach, e.g. the command line, NULL for none
+ */
+void traceSpan(const char *name, long long start, const char *text) {
+	long long end = traceNow();
+
+	if(!tracing || start == 0)
+		return;
+	beginEvent(name, 'X', start, tracePid);
+	appendf(",\"dur\":%lld.%03lld", (end - start) / 1000, (end - start) % 1000);
+	if(text) {
+		appendf(",\"args\":{\"text\":");
+		appendString(text);
+		appendf("}");
+	}
+	endEvent();
+}
+
+/**
+ * @brief Record the start of a process
+ * 
+ * The time the shell took to start it is a span on the shell's track.
+ * The process gets a track of its own, named after its program, with a
+ * span from now until traceReap ends it.
+ * 
+ * @param start Time the launch started, from traceNow
+ * @param pid pid of new process
+ * @param pgid Process group it joins
+ * @param argv Its argument vector
+ */
+void traceLaunch(long long start, pid_t pid, pid_t pgid, char **argv) {
+	long long now = traceNow();
+
+	if(!tracing || start == 0)
+		return;
+	beginEvent("launch", 'X', start, tracePid);
+	appendf(",\"dur\":%lld.%03lld,\"args\":{\"pid\":%d,\"pgid\":%d,\"file\":", (now - start) / 1000, (now - start) % 1000, pid, pgid);
+	appendString(argv[0]);
+	appendf("}");
+	endEvent();
+
+	nameTrack(pid, argv[0]);
+	beginEvent(argv[0], 'B', now, pid);
+	endEvent();
+}
+
+/**
+ * @brief Record a change of the foreground process group of the terminal
+ * 
+ * @param pgid New foreground process group
+ */
+void traceTerminal(pid_t pgid) {
+	if(!tracing)
+		return;
+	beginEvent("tcsetpgrp", 'i', traceNow(), tracePid);
+	appendf(",\"s\":\"t\",\"args\":{\"pgid\":%d}", pgid);
+	endEvent();
+}
+
+/**
+ * @brief Record a job being continued with SIGCONT
+ * 
+ * @param pgid Process group of job
+ */
+void traceContinue(pid_t pgid) {
+	if(!tracing)
+		return;
+	beginEvent("continue", 'i', traceNow(), tracePid);
+	appendf(",\"s\":\"t\",\"args\":{\"pgid\":%d}", pgid);
+	endEvent();
+}
+
+/**
+ * @brief Record a status reported by wait4
+ * 
+ * A stop is an instant on the track of the process, an exit ends the
+ * span traceLaunch started on it.
+ * 
+ * @param pid pid of process
+ * @param status Status from wait4
+ */
+void traceReap(pid_t pid, int status) {
+	if(!tracing)
+		return;
+	if(WIFSTOPPED(status)) {
+		beginEvent("stop", 'i', traceNow(), pid);
+		appendf(",\"s\":\"t\",\"args\":{\"signal\":%d}", WSTOPSIG(status));
+	}
+	else {
+		beginEvent("reap", 'E', traceNow(), pid);
+		if(WIFEXITED(status))
+			appendf(",\"args\":{\"exit\":%d}", WEXITSTATUS(status));
+		else
+			appendf(",\"args\":{\"signal\":%d}", WTERMSIG(status));
+	}
+	endEvent();
+}
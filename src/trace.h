@@ -0,0 +1,78 @@
+/* Events are kept in a buffer of this size and written once it is full */
+#define TRACE_BUF_SIZE (64 * 1024)
+
+/* Room left in the buffer before an event is added, more than any event takes */
+#define TRACE_EVENT_MAX 2048
+
+/* Longest text of a command line kept in an event */
+#define TRACE_LINE_MAX 256
+
+/* Whether events are being recorded */
+extern bool tracing;
+
+/**
+ * Start recording events to a file in Chrome Trace Event JSON, stopping
+ * any trace already running
+ * @param path file to write, truncated
+ * @return 0 on success, -1 if it could not be opened
+ */
+int startTrace(const char *path);
+
+/**
+ * Write the events still buffered, end the JSON array and close the file
+ */
+void stopTrace();
+
+/**
+ * Forget the trace without writing anything, in a forked child whose
+ * buffer is a copy of the shell's
+ */
+void dropTrace();
+
+/**
+ * Print the file being traced to and the number of events recorded
+ */
+void printTraceStatus();
+
+/**
+ * Current time for a trace event
+ * @return nanoseconds from CLOCK_MONOTONIC, 0 while not tracing
+ */
+long long traceNow();
+
+/**
+ * Record a span of the shell itself, like reading or parsing a line
+ * @param name name of the span
+ * @param start time it started, from traceNow
+ * @param text text to attach, e.g. the command line, NULL for none
+ */
+void traceSpan(const char *name, long long start, const char *text);
+
+/**
+ * Record the start of a process, which gets a track of its own lasting
+ * until it is reaped
+ * @param start time the launch started, from traceNow
+ * @param pid pid of new process
+ * @param pgid process group it joins
+ * @param argv its argument vector
+ */
+void traceLaunch(long long start, pid_t pid, pid_t pgid, char **argv);
+
+/**
+ * Record a change of the foreground process group of the terminal
+ * @param pgid new foreground process group
+ */
+void traceTerminal(pid_t pgid);
+
+/**
+ * Record a job being continued with SIGCONT
+ * @param pgid process group of job
+ */
+void traceContinue(pid_t pgid);
+
+/**
+ * Record a status reported by wait4, which stops a process or ends its track
+ * @param pid pid of process
+ * @param status status from wait4
+ */
+void traceReap(pid_t pid, int status);
@@ -0,0 +1,357 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include "parse.h"
+#include "wildcard.h"
+
+/* Record of a directory entry as getdents64 returns it */
+struct linuxDirent {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/* Listings of the directories globbed in most recently */
+static dirListing listings[WILDCARD_CACHE_SIZE];
+static unsigned long useCounter = 0;
+
+/* Buffer getdents64 fills, allocated on first use */
+static char *dentsBuf = NULL;
+
+/* Paths matched so far, to become an argument vector */
+typedef struct {
+	char **words;
+	int numWords;
+	int maxWords;
+	arena *mem;
+} wordList;
+
+/**
+ * @brief Adds a word to a list, copied into its arena
+ * 
+ * @param list Pointer to list
+ * @param word Word
+ * @param len Length of word
+ * @param copy Whether the word has to be copied, as it is not in the arena
+ */
+static void addWord(wordList *list, char *word, size_t len, bool copy) {
+	if(list->numWords == list->maxWords) {
+		list->maxWords = list->maxWords ? 2 * list->maxWords : 16;
+		if((list->words = realloc(list->words, list->maxWords * sizeof(char *))) == NULL) {
+			perror("glob");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(copy) {
+		word = memcpy(arenaAlloc(list->mem, len + 1), word, len);
+		word[len] = '\0';
+	}
+	list->words[list->numWords++] = word;
+}
+
+/**
+ * @brief Tell whether a word has * or ? to expand
+ * 
+ * @param word Word
+ * @return true if it has
+ */
+bool hasWildcards(const char *word) {
+	return strpbrk(word, "*?") != NULL;
+}
+
+/**
+ * @brief Tells whether a name matches a component of a pattern
+ * 
+ * * matches any run of characters and ? any one character. A name starting
+ * with a dot only matches a pattern starting with one.
+ * 
+ * @param pat Pattern component
+ * @param len Length of pattern component
+ * @param name Name
+ * @return true if it matches
+ */
+static bool matchName(const char *pat, size_t len, const char *name) {
+	const char *retry = NULL;
+	size_t p = 0, star = 0;
+
+	if(name[0] == '.' && pat[0] != '.')
+		return false;
+
+	/* On a mismatch after a *, let that * take one more character */
+	while(*name) {
+		if(p < len && pat[p] == '*') {
+			star = ++p;
+			retry = name;
+		}
+		else if(p < len && (pat[p] == '?' || pat[p] == *name)) {
+			p++;
+			name++;
+		}
+		else if(retry) {
+			p = star;
+			name = ++retry;
+		}
+		else {
+			return false;
+		}
+	}
+	while(p < len && pat[p] == '*')
+		p++;
+	return p == len;
+}
+
+/* Names of the listing being sorted, for compareEntries */
+static const char *sortNames;
+
+/**
+ * @brief Compares two entries of a listing by name, for qsort
+ * 
+ */
+static int compareEntries(const void *a, const void *b) {
+	return strcmp(sortNames + ((const dirEntry *)a)->name, sortNames + ((const dirEntry *)b)->name);
+}
+
+/**
+ * @brief Reads the names in a directory into a listing
+ * 
+ * Entries are read with getdents64 into a large buffer, so even a
+ * directory of hundreds of thousands of files takes few system calls, and
+ * their d_type is kept so that no file has to be stat'ed to tell a
+ * directory from a file.
+ * 
+ * @param l Pointer to listing, whose old names are dropped
+ * @param dir Path of directory
+ * @param st Status of directory, taken before it is read
+ * @return true on success, false if it could not be read
+ */
+static bool readListing(dirListing *l, const char *dir, struct stat *st) {
+	struct linuxDirent *d;
+	struct timespec now;
+	size_t used = 0, len;
+	int fd, maxEntries = l->numEntries;
+	long n;
+
+	if(dentsBuf == NULL && (dentsBuf = malloc(WILDCARD_DENTS_SIZE)) == NULL) {
+		perror("glob");
+		exit(EXIT_FAILURE);
+	}
+	if((fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+		return false;
+
+	l->numEntries = 0;
+	while((n = syscall(SYS_getdents64, fd, dentsBuf, WILDCARD_DENTS_SIZE)) > 0) {
+		for(long off = 0; off < n; off += d->d_reclen) {
+			d = (struct linuxDirent *)(dentsBuf + off);
+			if(d->d_name[0] == '.' && (d->d_name[1] == '\0' || (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+				continue;
+
+			len = strlen(d->d_name) + 1;
+			if(used + len > l->namesSize) {
+				l->namesSize = l->namesSize ? 2 * l->namesSize : 4096;
+				while(used + len > l->namesSize)
+					l->namesSize *= 2;
+				if((l->names = realloc(l->names, l->namesSize)) == NULL) {
+					perror("glob");
+					exit(EXIT_FAILURE);
+				}
+			}
+			if(l->numEntries == maxEntries) {
+				maxEntries = maxEntries ? 2 * maxEntries : 64;
+				if((l->entries = realloc(l->entries, maxEntries * sizeof(dirEntry))) == NULL) {
+					perror("glob");
+					exit(EXIT_FAILURE);
+				}
+			}
+			memcpy(l->names + used, d->d_name, len);
+			l->entries[l->numEntries].name = used;
+			l->entries[l->numEntries].type = d->d_type;
+			l->numEntries++;
+			used += len;
+		}
+	}
+	close(fd);
+	if(n == -1) {
+		l->ino = 0;
+		return false;
+	}
+
+	sortNames = l->names;
+	qsort(l->entries, l->numEntries, sizeof(dirEntry), compareEntries);
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	l->dev = st->st_dev;
+	l->ino = st->st_ino;
+	l->mtime = st->st_mtim;
+	l->racy = now.tv_sec - st->st_mtim.tv_sec < 2;
+	return true;
+}
+
+/**
+ * @brief Gets the listing of a directory, read again only if it changed
+ * 
+ * A directory globbed in before costs a single stat: its listing is kept
+ * as long as its inode has the same modification time.
+ * 
+ * @param dir Path of directory
+ * @return Pointer to listing, valid until the next call, NULL if it is
+ * not a directory or could not be read
+ */
+static dirListing *listDirectory(const char *dir) {
+	dirListing *l = NULL;
+	struct stat st;
+
+	if(stat(dir, &st) == -1 || !S_ISDIR(st.st_mode))
+		return NULL;
+
+	for(int i = 0; i < WILDCARD_CACHE_SIZE; i++) {
+		if(listings[i].ino == st.st_ino && listings[i].dev == st.st_dev) {
+			l = &listings[i];
+			break;
+		}
+		if(l == NULL || listings[i].used < l->used)
+			l = &listings[i];
+	}
+
+	l->used = ++useCounter;
+	if(l->ino == st.st_ino && l->dev == st.st_dev && !l->racy &&
+	   l->mtime.tv_sec == st.st_mtim.tv_sec && l->mtime.tv_nsec == st.st_mtim.tv_nsec)
+		return l;
+	return readListing(l, dir, &st) ? l : NULL;
+}
+
+/**
+ * @brief Tells whether an entry of a listing is a directory
+ * 
+ * Only a symbolic link, or an entry of a file system without d_type,
+ * needs a stat.
+ * 
+ * @param path Path of entry
+ * @param type Its d_type
+ * @return true if it is a directory or a link to one
+ */
+static bool isDirectory(const char *path, unsigned char type) {
+	struct stat st;
+
+	if(type == DT_DIR)
+		return true;
+	if(type != DT_LNK && type != DT_UNKNOWN)
+		return false;
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+/**
+ * @brief Adds the paths matching a pattern to a list
+ * 
+ * Components without wildcards are taken as they are, the others are
+ * matched against the listing of the directory so far.
+ * 
+ * @param path Buffer of PATH_MAX bytes holding the directory so far,
+ * empty or ending with a slash
+ * @param len Length of path
+ * @param pattern Components of the pattern left
+ * @param list Pointer to list
+ */
+static void expandPath(char *path, size_t len, const char *pattern, wordList *list) {
+	const char *slash = strchr(pattern, '/');
+	size_t compLen = slash ? (size_t)(slash - pattern) : strlen(pattern), nameLen, numDirs = 0;
+	char *name, **dirs = NULL;
+	dirListing *l;
+	struct stat st;
+
+	if(memchr(pattern, '*', compLen) == NULL && memchr(pattern, '?', compLen) == NULL) {
+		if(len + compLen + 2 > PATH_MAX)
+			return;
+		memcpy(path + len, pattern, compLen);
+		len += compLen;
+		path[len] = '\0';
+		/* A last component without wildcards must exist */
+		if(slash == NULL) {
+			if(lstat(path, &st) == 0)
+				addWord(list, path, len, true);
+			return;
+		}
+		path[len++] = '/';
+		path[len] = '\0';
+		expandPath(path, len, slash + 1, list);
+		return;
+	}
+
+	if((l = listDirectory(len ? path : ".")) == NULL)
+		return;
+
+	for(int i = 0; i < l->numEntries; i++) {
+		name = l->names + l->entries[i].name;
+		if(!matchName(pattern, compLen, name))
+			continue;
+		nameLen = strlen(name);
+		if(len + nameLen + 2 > PATH_MAX)
+			continue;
+		memcpy(path + len, name, nameLen + 1);
+		if(slash == NULL) {
+			addWord(list, path, len + nameLen, true);
+		}
+		else if(isDirectory(path, l->entries[i].type)) {
+			/* Globbing in them may replace this listing, keep the names */
+			if((dirs = realloc(dirs, (numDirs + 1) * sizeof(char *))) == NULL || (dirs[numDirs++] = strdup(name)) == NULL) {
+				perror("glob");
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+
+	for(size_t i = 0; i < numDirs; i++) {
+		nameLen = strlen(dirs[i]);
+		memcpy(path + len, dirs[i], nameLen);
+		path[len + nameLen] = '/';
+		path[len + nameLen + 1] = '\0';
+		expandPath(path, len + nameLen + 1, slash + 1, list);
+		free(dirs[i]);
+	}
+	free(dirs);
+	path[len] = '\0';
+}
+
+/**
+ * @brief Expand the words of an argument vector with * or ? into the paths
+ * of the files they match
+ * 
+ * Like sh, the paths of a word are in byte order and a word that matches
+ * nothing is kept as it is.
+ * 
+ * @param argv NULL terminated argument vector
+ * @param mem Arena to allocate the new vector and paths from
+ * @return New NULL terminated argument vector
+ */
+char **expandWildcards(char **argv, arena *mem) {
+	wordList list = { NULL, 0, 0, mem };
+	char path[PATH_MAX], **expanded;
+	int before;
+
+	for(int i = 0; argv[i]; i++) {
+		before = list.numWords;
+		if(hasWildcards(argv[i])) {
+			path[0] = '\0';
+			expandPath(path, 0, argv[i], &list);
+		}
+		if(list.numWords == before)
+			addWord(&list, argv[i], 0, false);
+	}
+
+	expanded = arenaAlloc(mem, (list.numWords + 1) * sizeof(char *));
+	memcpy(expanded, list.words, list.numWords * sizeof(char *));
+	expanded[list.numWords] = NULL;
+	free(list.words);
+	return expanded;
+}
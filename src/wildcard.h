@@ -0,0 +1,52 @@
+/* Directory listings kept, the least recently used one being replaced */
+#define WILDCARD_CACHE_SIZE 16
+
+/* Bytes of directory entries read by each getdents64 */
+#define WILDCARD_DENTS_SIZE (256 * 1024)
+
+/**
+ * Entry of a directory listing
+ */
+typedef struct {
+	/* Offset of its name in the names of the listing */
+	size_t name;
+	/* d_type from getdents64, DT_UNKNOWN where the file system gives none */
+	unsigned char type;
+} dirEntry;
+
+/**
+ * Names in a directory sorted in byte order, kept as long as the directory
+ * has the modification time it had when they were read
+ */
+typedef struct {
+	/* Directory they were read from, st_ino of 0 if the slot is free */
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	/* Read within a second of a change, which a later change in the same
+	   tick of the file system clock would not show in mtime */
+	bool racy;
+	dirEntry *entries;
+	int numEntries;
+	/* Names, each NUL terminated */
+	char *names;
+	size_t namesSize;
+	/* Value of the use counter when it was last looked up */
+	unsigned long used;
+} dirListing;
+
+/**
+ * Tell whether a word has * or ? to expand
+ * @param word word
+ * @return true if it has
+ */
+bool hasWildcards(const char *word);
+
+/**
+ * Expand the words of an argument vector with * or ? into the paths of the
+ * files they match, in byte order. A word that matches nothing is kept.
+ * @param argv NULL terminated argument vector
+ * @param mem arena to allocate the new vector and paths from
+ * @return new NULL terminated argument vector
+ */
+char **expandWildcards(char **argv, arena *mem);